@@ -0,0 +1,1094 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the benchmark suite of the simulation hot paths.
+ *
+ * The environment and launcher modules are included directly, so the
+ * benchmarks can call their internal (static) functions without
+ * changing the interface of the modules. No task is spawned: every
+ * benchmark runs on the main thread with a memory bitmap in place of
+ * the screen, so the suite does not need a display or superuser
+ * privileges.
+ *
+ * Every benchmark is run for BENCH_REPEATS batches, each one long
+ * enough to last at least BENCH_BATCH_NS, and the results are printed
+ * on stdout as one JSON object per line. All random inputs are
+ * generated from the seed given on the command line, so two builds
+ * can be compared on the same inputs. An optional size of the
+ * environment (WxH) follows the seed, for scaling tests.
+ *
+ * The false sharing benchmark is the only one with threads: workers
+ * on different cores move interleaved missiles, as the missile tasks
+ * do, with the packed layout of the missiles used before and with
+ * the cache line aligned one, for a growing number of missiles and
+ * of workers (up to the online cores).
+ *
+ * The priority inversion benchmark needs real-time privileges (it is
+ * skipped without them): on a single CPU a low priority thread holds
+ * the environment, a high priority thread blocks on it and a middle
+ * priority thread runs for BENCH_INV_SPIN_NS meanwhile. The blocking
+ * time of the high priority thread is bounded by the critical section
+ * with the environment, while with a plain semaphore (the lock used
+ * before) it also includes the middle priority thread. The benchmark
+ * fails (non-zero exit status) if a blocking time with the environment
+ * exceeds BENCH_INV_CS_NS plus BENCH_INV_MARGIN_NS.
+ *
+********************************************************************/
+
+// CPU affinity of the priority inversion threads.
+#define _GNU_SOURCE
+#include "gestor.c"
+#include "launchers.c"
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/********************************************************************
+ * BENCHMARK PARAMETERS
+********************************************************************/
+
+// Number of measured batches for every benchmark.
+#define BENCH_REPEATS       15
+// Minimum duration of a measured batch.
+#define BENCH_BATCH_NS      (20 * 1000 * 1000) // 20 milliseconds
+// Number of pre-generated random inputs for a benchmark.
+#define BENCH_INPUTS        256
+// Default seed of the random inputs.
+#define BENCH_SEED          1
+// Deltatime of an attacker missile step.
+#define BENCH_DELTATIME     ((float)ATK_MISSILE_PERIOD / DELTA_FACTOR)
+// Upper bound of the steps of a scenario.
+#define BENCH_MAX_TICKS     100000
+// Number of salvos in the burst scenario.
+#define BENCH_SALVOS        5
+// Steps of every missile in the false sharing benchmark.
+#define BENCH_FS_STEPS      50000
+// Minimum and maximum number of missiles of the false sharing benchmark.
+#define BENCH_FS_MIN        4
+#define BENCH_FS_MAX        64
+// Runs of the priority inversion benchmark for every lock.
+#define BENCH_INV_RUNS      10
+// Critical section of the low priority thread.
+#define BENCH_INV_CS_NS     (2 * 1000 * 1000) // 2 milliseconds
+// Execution of the middle priority thread.
+#define BENCH_INV_SPIN_NS   (20 * 1000 * 1000) // 20 milliseconds
+// Margin of the blocking time with the environment over the critical
+// section (lock handoff and scheduling latency).
+#define BENCH_INV_MARGIN_NS (1 * 1000 * 1000) // 1 millisecond
+// Priorities of the threads of the priority inversion benchmark.
+#define BENCH_INV_LOW       1
+#define BENCH_INV_MIDDLE    2
+#define BENCH_INV_HIGH      3
+
+// Flag used to end all tasks loops (never set by the benchmarks).
+int end;
+
+// Sink used to avoid the elimination of the benchmarked calls.
+static volatile long    sink;
+
+// Bitmap used as frame buffer by the display benchmarks.
+static BITMAP           *frame;
+
+// Pre-generated random inputs.
+static pos_t            positions[BENCH_INPUTS];
+static trajectory_t     trajectories[BENCH_INPUTS];
+static pos_t            last_positions[BENCH_INPUTS];
+
+// Single benchmark: prepares its inputs and runs a number of iterations.
+typedef struct
+{
+    char    *name;
+    void    (*setup)();
+    void    (*run)(long iterations);
+}   bench_t;
+
+/********************************************************************
+ * TIMING
+********************************************************************/
+
+/*
+ * Get the monotonic clock in nanoseconds.
+ *
+ * ~return: current time in nanoseconds.
+ */
+static double now_ns()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * NANOSECOND_TO_SECONDS + t.tv_nsec;
+}
+
+/*
+ * Compare two doubles, used to sort the measures.
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double da, db;
+
+    da = *(const double *)a;
+    db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+/*
+ * Find the number of iterations needed for a batch to last at least
+ * BENCH_BATCH_NS.
+ *
+ * run: benchmark function.
+ * ~return: number of iterations of a batch.
+ */
+static long calibrate_iterations(void (*run)(long))
+{
+    long    n;
+    double  t;
+
+    n = 1;
+    do
+    {
+        n *= 2;
+        t = now_ns();
+        run(n);
+        t = now_ns() - t;
+    } while (t < BENCH_BATCH_NS && n < (1L << 40));
+
+    return n;
+}
+
+/*
+ * Run a benchmark and print its results as a JSON line.
+ *
+ * b: reference to the benchmark.
+ */
+static void run_bench(bench_t *b)
+{
+    double  ns[BENCH_REPEATS], t, mean;
+    long    n;
+    int     i;
+
+    b->setup();
+    n = calibrate_iterations(b->run);
+    mean = 0;
+
+    for (i = 0; i < BENCH_REPEATS; i++)
+    {
+        b->setup();
+        t = now_ns();
+        b->run(n);
+        ns[i] = (now_ns() - t) / n;
+        mean += ns[i] / BENCH_REPEATS;
+    }
+
+    qsort(ns, BENCH_REPEATS, sizeof(double), cmp_double);
+
+    printf("{\"name\":\"%s\",\"iterations\":%li,\"repeats\":%i,"
+           "\"ns_min\":%.3f,\"ns_median\":%.3f,\"ns_mean\":%.3f,"
+           "\"ns_max\":%.3f}\n",
+           b->name, n, BENCH_REPEATS, ns[0], ns[BENCH_REPEATS / 2], mean,
+           ns[BENCH_REPEATS - 1]);
+    fflush(stdout);
+}
+
+/********************************************************************
+ * WORLD SETUP
+********************************************************************/
+
+/*
+ * Reset the environment, the missile queues and the frame buffers.
+ */
+static void reset_world()
+{
+    init_env();
+    init_launchers();
+    clear_to_color(frame, BKG_COLOR);
+    clear_to_color(screen, BKG_COLOR);
+}
+
+/*
+ * Get a random position inside the free part of the environment.
+ *
+ * ~return: random position far from walls and goal.
+ */
+static pos_t random_free_pos()
+{
+    pos_t   pos;
+    int     margin;
+
+    margin = WALL_THICKNESS + 2 * MISSILE_RADIUS + 1;
+    pos.x = (int)frand(margin, xwin - margin);
+    pos.y = (int)frand(margin, GOAL_START_Y - 2 * MISSILE_RADIUS);
+
+    return pos;
+}
+
+/*
+ * Place a missile in the environment.
+ *
+ * m_gestor: reference to the gestor of the missile.
+ * type: type of the missile.
+ * index: index of the missile in its queue.
+ * pos: position of the missile.
+ * ~return: reference to the placed missile.
+ */
+static missile_t *place_missile(missile_gestor_t *m_gestor,
+                                missile_type_t type, int index, pos_t pos)
+{
+    missile_t   *missile;
+
+    missile = &(m_gestor->queue[index]);
+    init_empty_missile(missile);
+    missile->index = index;
+    missile->missile_type = type;
+    missile->partial_x = missile->x = pos.x;
+    missile->partial_y = missile->y = pos.y;
+
+    update_missile_cell(missile);
+
+    return missile;
+}
+
+/*
+ * Place an attacker missile with a random speed and direction.
+ *
+ * index: index of the missile in the attacker queue.
+ * ~return: reference to the placed missile.
+ */
+static missile_t *place_random_attacker(int index)
+{
+    missile_t   *missile;
+    pos_t       pos;
+
+    pos.x = (int)frand(WALL_THICKNESS + MISSILE_RADIUS + 1,
+                       xwin - WALL_THICKNESS - MISSILE_RADIUS - 1);
+    pos.y = WALL_THICKNESS + MISSILE_RADIUS + 1;
+
+    missile = place_missile(&atk_gestor, ATTACKER, index, pos);
+    missile->speed = frand(MIN_ATK_SPEED, MAX_ATK_SPEED);
+    missile->angle = frand(MAX_ATK_ANGLE, 180 - MAX_ATK_ANGLE);
+
+    return missile;
+}
+
+/********************************************************************
+ * MICROBENCHMARKS
+********************************************************************/
+
+/*
+ * Setup: N tracked attackers scattered in the environment.
+ */
+static void setup_scan_target()
+{
+    int i;
+
+    reset_world();
+    for (i = 0; i < N; i++)
+    {
+        place_missile(&atk_gestor, ATTACKER, i, positions[i]);
+        CELL(positions[i].x, positions[i].y).target = i;
+    }
+}
+
+static void run_scan_target(long iterations)
+{
+    long    i;
+    pos_t   pos;
+
+    for (i = 0; i < iterations; i++)
+    {
+        pos = scan_env_for_target_pos(i % N);
+        sink += pos.x;
+    }
+}
+
+/*
+ * Setup: a single untracked attacker visible on the screen.
+ */
+static void setup_search_target()
+{
+    reset_world();
+    place_missile(&atk_gestor, ATTACKER, 0, positions[0]);
+    putpixel(screen, positions[0].x, positions[0].y, ATTACKER_COLOR);
+}
+
+static void run_search_target(long iterations)
+{
+    long    i;
+
+    for (i = 0; i < iterations; i++)
+    {
+        sink += search_screen_for_target(0);
+    }
+}
+
+/*
+ * Setup: a single attacker missile in the free part of the environment.
+ */
+static void setup_collision()
+{
+    reset_world();
+    place_missile(&atk_gestor, ATTACKER, 0, positions[0]);
+}
+
+static void run_collision(long iterations)
+{
+    missile_t   *missile;
+    long        i;
+
+    missile = &(atk_gestor.queue[0]);
+    for (i = 0; i < iterations; i++)
+    {
+        sink += collision_around(missile->x - MISSILE_RADIUS,
+                                 missile->y - MISSILE_RADIUS,
+                                 missile->x + MISSILE_RADIUS,
+                                 missile->y + MISSILE_RADIUS, missile);
+    }
+}
+
+/*
+ * Setup: N attacker and N defender missiles in the environment.
+ */
+static void setup_draw()
+{
+    int i;
+
+    reset_world();
+    for (i = 0; i < N; i++)
+    {
+        place_missile(&atk_gestor, ATTACKER, i, positions[2 * i]);
+        place_missile(&def_gestor, DEFENDER, i, positions[2 * i + 1]);
+    }
+}
+
+static void run_draw(long iterations)
+{
+    long    i;
+
+    /* Every frame is drawn as the first one: full redraw. */
+    for (i = 0; i < iterations; i++)
+    {
+        last_frame.valid = 0;
+        draw_frame(frame);
+    }
+}
+
+/*
+ * Setup: N attacker and N defender missiles and a first full frame.
+ */
+static void setup_draw_frame()
+{
+    setup_draw();
+    draw_frame(frame);
+}
+
+static void run_draw_frame(long iterations)
+{
+    long    i;
+    int     k;
+
+    for (i = 0; i < iterations; i++)
+    {
+        /* Every missile moves by a pixel, as in a display period. */
+        for (k = 0; k < env.nentities; k++)
+        {
+            env.entity[k].pos.x += i % 2 ? 1 : -1;
+        }
+        draw_frame(frame);
+    }
+}
+
+static void setup_expected_x()
+{
+}
+
+static void run_expected_x(long iterations)
+{
+    long    i;
+    int     k;
+
+    for (i = 0; i < iterations; i++)
+    {
+        k = i % BENCH_INPUTS;
+        sink += get_expected_position_x(&trajectories[k], &last_positions[k]);
+    }
+}
+
+static void setup_fifo()
+{
+    init_launchers();
+}
+
+static void run_fifo(long iterations)
+{
+    fifo_queue_gestor_t *gestor;
+    long                i;
+    int                 index;
+
+    gestor = &(def_gestor.gestor);
+    for (i = 0; i < iterations; i++)
+    {
+        index = request_def_index();
+        sem_wait(&(gestor->mutex));
+        splice_index(gestor, index);
+        sink += index;
+    }
+}
+
+static void setup_move()
+{
+    reset_world();
+    place_random_attacker(0);
+}
+
+static void run_move(long iterations)
+{
+    missile_t   *missile;
+    long        i;
+
+    missile = &(atk_gestor.queue[0]);
+    for (i = 0; i < iterations; i++)
+    {
+        move_missile(missile, BENCH_DELTATIME);
+        sink += missile->x;
+    }
+}
+
+/********************************************************************
+ * SCENARIOS
+********************************************************************/
+
+/*
+ * Step all the live attackers of the scenario as their tasks would do
+ * in a period, emulating the display and the defender launcher at
+ * their own rate.
+ *
+ * alive: array of flags of the live attackers, updated on collision.
+ * tick: number of the current step.
+ * ~return: number of attackers still alive.
+ */
+static int scenario_tick(int *alive, long tick)
+{
+    missile_t   *missile;
+    int         i, oldx, oldy, count;
+
+    count = 0;
+    for (i = 0; i < N; i++)
+    {
+        if (!alive[i])
+        {
+            continue;
+        }
+
+        missile = &(atk_gestor.queue[i]);
+        oldx = missile->x;
+        oldy = missile->y;
+        move_missile(missile, BENCH_DELTATIME);
+        alive[i] = !update_missile_env(missile, oldx, oldy);
+        count += alive[i];
+    }
+
+    /* Display and defender launcher are slower than the attackers. */
+    if (tick % (DISPLAY_PERIOD / ATK_MISSILE_PERIOD + 1) == 0)
+    {
+        draw_frame(frame);
+    }
+    if (tick % (DEF_LAUNCHER_PERIOD / ATK_MISSILE_PERIOD) == 0)
+    {
+        sink += search_screen_for_target(0);
+    }
+
+    return count;
+}
+
+/*
+ * Run salvos of attackers until all of them collide and print the
+ * results of the scenario as a JSON line.
+ *
+ * name: name of the scenario.
+ * attackers: number of simultaneous attackers in a salvo.
+ * salvos: number of salvos.
+ */
+static void run_scenario(char *name, int attackers, int salvos)
+{
+    int     alive[N], i, s, count;
+    long    ticks;
+    double  t;
+
+    reset_world();
+    ticks = 0;
+
+    t = now_ns();
+    for (s = 0; s < salvos; s++)
+    {
+        for (i = 0; i < N; i++)
+        {
+            alive[i] = i < attackers;
+            if (alive[i])
+            {
+                place_random_attacker(i);
+            }
+        }
+
+        do
+        {
+            count = scenario_tick(alive, ticks++);
+        } while (count > 0 && ticks < BENCH_MAX_TICKS);
+    }
+    t = now_ns() - t;
+
+    printf("{\"name\":\"%s\",\"attackers\":%i,\"salvos\":%i,"
+           "\"ticks\":%li,\"ns_per_tick\":%.3f,\"ms_total\":%.3f,"
+           "\"atk_points\":%i,\"def_points\":%i}\n",
+           name, attackers, salvos, ticks, t / ticks, t / 1e6,
+           env.atk_points, env.def_points);
+    fflush(stdout);
+}
+
+/********************************************************************
+ * FALSE SHARING
+********************************************************************/
+
+// Layout of a missile before the alignment to the cache lines: the
+// kinematics, the metadata and a mutex packed one after the other.
+typedef struct
+{
+    int             x, y;
+    float           partial_x, partial_y;
+    float           angle;
+    float           speed;
+    int             index;
+    int             deleted;
+    int             assigned_target;
+    sem_t           mutex;
+    missile_type_t  missile_type;
+}   packed_missile_t;
+
+// Missiles moved by the workers, in one of the two layouts.
+typedef struct
+{
+    int                 aligned;    // 1 for missile_t, 0 for packed.
+    int                 missiles;   // Number of missiles.
+    int                 workers;    // Number of workers.
+    missile_t           *queue;     // Aligned missiles.
+    packed_missile_t    *packed;    // Packed missiles.
+    pthread_barrier_t   start;      // Start of the workers.
+}   sharing_world_t;
+
+// Worker: moves the missiles of index id, id + workers, ...
+typedef struct
+{
+    sharing_world_t     *world;
+    int                 id;
+}   sharing_worker_t;
+
+/*
+ * Move a missile of the packed layout by a step, as move_missile does.
+ *
+ * m: reference to the missile.
+ * dx, dy: step of the missile.
+ */
+static void step_packed(packed_missile_t *m, float dx, float dy)
+{
+    if (!m->deleted)
+    {
+        m->partial_x += dx;
+        m->partial_y += dy;
+        m->x = (int)m->partial_x;
+        m->y = (int)m->partial_y;
+    }
+}
+
+/*
+ * Move a missile of the aligned layout by a step, as move_missile does.
+ *
+ * m: reference to the missile.
+ * dx, dy: step of the missile.
+ */
+static void step_aligned(missile_t *m, float dx, float dy)
+{
+    if (!m->deleted)
+    {
+        m->partial_x += dx;
+        m->partial_y += dy;
+        m->x = (int)m->partial_x;
+        m->y = (int)m->partial_y;
+    }
+}
+
+/*
+ * Worker thread: move its missiles for BENCH_FS_STEPS steps.
+ *
+ * arg: reference to the worker.
+ */
+static void *sharing_worker(void *arg)
+{
+    sharing_worker_t    *w;
+    sharing_world_t     *world;
+    missile_t           *m;
+    float               dx[BENCH_FS_MAX], dy[BENCH_FS_MAX], rad;
+    int                 i, s;
+
+    w = arg;
+    world = w->world;
+
+    /* The step of every missile is computed once, out of the loop: both
+     * layouts hold the same speed and angle, read from the aligned one. */
+    for (i = w->id; i < world->missiles; i += world->workers)
+    {
+        m = &(world->queue[i]);
+        rad = m->angle * (M_PI / 180);
+        dx[i] = m->speed * cos(rad) * BENCH_DELTATIME;
+        dy[i] = m->speed * sin(rad) * BENCH_DELTATIME;
+    }
+
+    pthread_barrier_wait(&world->start);
+
+    for (s = 0; s < BENCH_FS_STEPS; s++)
+    {
+        for (i = w->id; i < world->missiles; i += world->workers)
+        {
+            if (world->aligned)
+            {
+                step_aligned(&world->queue[i], dx[i], dy[i]);
+            }
+            else
+            {
+                step_packed(&world->packed[i], dx[i], dy[i]);
+            }
+        }
+
+        /* Every step is stored, as the tasks do on every period. */
+        __asm__ volatile("" : : : "memory");
+    }
+
+    return NULL;
+}
+
+/*
+ * Move the missiles with a number of workers and print the results as
+ * a JSON line.
+ *
+ * aligned: 1 for the aligned layout, 0 for the packed one.
+ * missiles: number of missiles, up to BENCH_FS_MAX.
+ * workers: number of worker threads, up to the missiles.
+ */
+static void run_false_sharing(int aligned, int missiles, int workers)
+{
+    sharing_world_t     world;
+    sharing_worker_t    worker[BENCH_FS_MAX];
+    pthread_t           thread[BENCH_FS_MAX];
+    double              t;
+    missile_t           *m;
+    int                 i;
+
+    world.aligned = aligned;
+    world.missiles = missiles;
+    world.workers = workers;
+    world.queue = aligned_alloc(CACHE_LINE, missiles * sizeof(missile_t));
+    world.packed = calloc(missiles, sizeof(packed_missile_t));
+
+    for (i = 0; i < missiles; i++)
+    {
+        m = &(world.queue[i]);
+        init_empty_missile(m);
+        m->speed = world.packed[i].speed = frand(MIN_ATK_SPEED, MAX_ATK_SPEED);
+        m->angle = world.packed[i].angle =
+            frand(MAX_ATK_ANGLE, 180 - MAX_ATK_ANGLE);
+    }
+
+    pthread_barrier_init(&world.start, NULL, workers + 1);
+
+    for (i = 0; i < workers; i++)
+    {
+        worker[i].world = &world;
+        worker[i].id = i;
+        pthread_create(&thread[i], NULL, sharing_worker, &worker[i]);
+    }
+
+    pthread_barrier_wait(&world.start);
+    t = now_ns();
+    for (i = 0; i < workers; i++)
+    {
+        pthread_join(thread[i], NULL);
+    }
+    t = now_ns() - t;
+
+    printf("{\"name\":\"false_sharing\",\"layout\":\"%s\","
+           "\"missile_size\":%i,\"missiles\":%i,\"workers\":%i,"
+           "\"ns_per_step\":%.3f,\"ms_total\":%.3f}\n",
+           aligned ? "aligned" : "packed",
+           (int)(aligned ? sizeof(missile_t) : sizeof(packed_missile_t)),
+           missiles, workers, t / ((double)BENCH_FS_STEPS * missiles),
+           t / 1e6);
+    fflush(stdout);
+
+    pthread_barrier_destroy(&world.start);
+    free(world.queue);
+    free(world.packed);
+}
+
+/********************************************************************
+ * PRIORITY INVERSION
+********************************************************************/
+
+// Run of the priority inversion benchmark.
+typedef struct
+{
+    int     env;            // 1 for the environment, 0 for the semaphore.
+    sem_t   sem;            // Plain semaphore, as the lock used before.
+    sem_t   go_high;        // Start of the high priority thread.
+    sem_t   go_middle;      // Start of the middle priority thread.
+    double  blocked;        // Blocking time of the high priority thread.
+}   inversion_t;
+
+/*
+ * Run on the CPU for a given time.
+ *
+ * ns: time to run (ns).
+ */
+static void spin(double ns)
+{
+    double  t;
+
+    t = now_ns();
+    while (now_ns() - t < ns)
+    {
+        sink++;
+    }
+}
+
+/*
+ * Lock of the inversion benchmark.
+ *
+ * inv: reference to the run.
+ * prio: priority of the access to the environment.
+ */
+static void inversion_lock(inversion_t *inv, int prio)
+{
+    if (inv->env)
+    {
+        access_env(prio, ENV_CALLER_TARGET_SEARCH);
+    }
+    else
+    {
+        sem_wait(&inv->sem);
+    }
+}
+
+/*
+ * Unlock of the inversion benchmark.
+ *
+ * inv: reference to the run.
+ * prio: priority of the access to the environment.
+ */
+static void inversion_unlock(inversion_t *inv, int prio)
+{
+    if (inv->env)
+    {
+        release_env(prio);
+    }
+    else
+    {
+        sem_post(&inv->sem);
+    }
+}
+
+/*
+ * Low priority thread: holds the lock for BENCH_INV_CS_NS, releasing
+ * the high priority thread once it holds it.
+ */
+static void *inversion_low(void *arg)
+{
+    inversion_t *inv;
+
+    inv = arg;
+
+    inversion_lock(inv, LOW_ENV_PRIO);
+    sem_post(&inv->go_high);
+    spin(BENCH_INV_CS_NS);
+    inversion_unlock(inv, LOW_ENV_PRIO);
+
+    return NULL;
+}
+
+/*
+ * Middle priority thread: runs for BENCH_INV_SPIN_NS, without the lock.
+ */
+static void *inversion_middle(void *arg)
+{
+    inversion_t *inv;
+
+    inv = arg;
+
+    sem_wait(&inv->go_middle);
+    spin(BENCH_INV_SPIN_NS);
+
+    return NULL;
+}
+
+/*
+ * High priority thread: releases the middle priority thread and
+ * measures its own blocking on the lock.
+ */
+static void *inversion_high(void *arg)
+{
+    inversion_t *inv;
+    double      t;
+
+    inv = arg;
+
+    sem_wait(&inv->go_high);
+    sem_post(&inv->go_middle);
+
+    t = now_ns();
+    inversion_lock(inv, HIGH_ENV_PRIO);
+    inv->blocked = now_ns() - t;
+    inversion_unlock(inv, HIGH_ENV_PRIO);
+
+    return NULL;
+}
+
+/*
+ * Create a real-time thread of the inversion benchmark on the first CPU.
+ *
+ * thread: reference to the thread to create.
+ * body: body of the thread.
+ * prio: fixed priority of the thread.
+ * inv: reference to the run.
+ * ~return: 0 on success, else an error number.
+ */
+static int inversion_thread(pthread_t *thread, void *(*body)(void *),
+                            int prio, inversion_t *inv)
+{
+    pthread_attr_t      attr;
+    struct sched_param  param;
+    cpu_set_t           cpus;
+    int                 ret;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(0, &cpus);
+    param.sched_priority = prio;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+
+    ret = pthread_create(thread, &attr, body, inv);
+
+    pthread_attr_destroy(&attr);
+
+    return ret;
+}
+
+/*
+ * Run the three threads of the inversion benchmark once. If a thread
+ * cannot be created the ones already created are released and joined.
+ *
+ * inv: reference to the run.
+ * ~return: 0 on success, -1 without real-time privileges.
+ */
+static int inversion_run(inversion_t *inv)
+{
+    pthread_t   high, middle, low;
+    int         ret;
+
+    sem_init(&inv->sem, 0, 1);
+    sem_init(&inv->go_high, 0, 0);
+    sem_init(&inv->go_middle, 0, 0);
+    ret = -1;
+
+    /* The waiting threads first: the low one starts the run. */
+    if (!inversion_thread(&high, inversion_high, BENCH_INV_HIGH, inv))
+    {
+        if (!inversion_thread(&middle, inversion_middle, BENCH_INV_MIDDLE,
+                              inv))
+        {
+            if (!inversion_thread(&low, inversion_low, BENCH_INV_LOW, inv))
+            {
+                pthread_join(low, NULL);
+                ret = 0;
+            }
+            else
+            {
+                sem_post(&inv->go_high); // No low thread to release it.
+            }
+            pthread_join(middle, NULL);
+        }
+        else
+        {
+            sem_post(&inv->go_high);
+        }
+        pthread_join(high, NULL);
+    }
+
+    sem_destroy(&inv->sem);
+    sem_destroy(&inv->go_high);
+    sem_destroy(&inv->go_middle);
+
+    return ret;
+}
+
+/*
+ * Run the priority inversion benchmark with a lock and print the
+ * blocking times of the high priority thread as a JSON line. With the
+ * environment the longest blocking time is checked against its bound.
+ *
+ * env: 1 for the environment, 0 for the plain semaphore.
+ * ~return: 0 on success, 1 if the bound is exceeded, -1 without
+ * real-time privileges.
+ */
+static int run_inversion(int env)
+{
+    inversion_t inv;
+    double      ms[BENCH_INV_RUNS], bound;
+    int         i, pass;
+
+    for (i = 0; i < BENCH_INV_RUNS; i++)
+    {
+        reset_world();
+        inv.env = env;
+
+        if (inversion_run(&inv) < 0)
+        {
+            return -1;
+        }
+
+        ms[i] = inv.blocked / 1e6;
+    }
+
+    qsort(ms, BENCH_INV_RUNS, sizeof(double), cmp_double);
+
+    /* The semaphore has no bound: it only shows the inversion. */
+    bound = (BENCH_INV_CS_NS + BENCH_INV_MARGIN_NS) / 1e6;
+    pass = !env || ms[BENCH_INV_RUNS - 1] <= bound;
+
+    printf("{\"name\":\"priority_inversion\",\"lock\":\"%s\","
+           "\"cs_ms\":%.3f,\"spin_ms\":%.3f,\"runs\":%i,"
+           "\"ms_blocked_median\":%.3f,\"ms_blocked_max\":%.3f",
+           env ? "env" : "semaphore", BENCH_INV_CS_NS / 1e6,
+           BENCH_INV_SPIN_NS / 1e6, BENCH_INV_RUNS,
+           ms[BENCH_INV_RUNS / 2], ms[BENCH_INV_RUNS - 1]);
+    if (env)
+    {
+        printf(",\"ms_bound\":%.3f,\"pass\":%s", bound,
+               pass ? "true" : "false");
+    }
+    printf("}\n");
+    fflush(stdout);
+
+    return !pass;
+}
+
+/********************************************************************
+ * MAIN
+********************************************************************/
+
+/*
+ * Generate the random inputs of the benchmarks from the seed.
+ *
+ * seed: seed of the random generator.
+ */
+static void generate_inputs(unsigned int seed)
+{
+    int i;
+
+    srand(seed);
+
+    for (i = 0; i < BENCH_INPUTS; i++)
+    {
+        positions[i] = random_free_pos();
+
+        last_positions[i] = random_free_pos();
+        trajectories[i].m = frand(-2, 2);
+        trajectories[i].b = get_line_b(trajectories[i].m, &last_positions[i]);
+        trajectories[i].speed = frand(MIN_ATK_SPEED, MAX_ATK_SPEED);
+    }
+}
+
+/*
+ * Initialize allegro without a display.
+ */
+static void headless_init()
+{
+    install_allegro(SYSTEM_NONE, &errno, atexit);
+    set_color_depth(8);
+    frame = create_bitmap(xwin, ywin);
+    screen = create_bitmap(xwin, ywin);
+}
+
+int main(int argc, char **argv)
+{
+    bench_t         benchs[] = {
+        {"scan_env_for_target_pos", setup_scan_target, run_scan_target},
+        {"search_screen_for_target", setup_search_target, run_search_target},
+        {"collision_around", setup_collision, run_collision},
+        {"draw_env", setup_draw, run_draw},
+        {"draw_frame", setup_draw_frame, run_draw_frame},
+        {"get_expected_position_x", setup_expected_x, run_expected_x},
+        {"fifo_index_queue", setup_fifo, run_fifo},
+        {"move_missile", setup_move, run_move},
+    };
+    char            name[INFO_LEN];
+    unsigned int    seed;
+    int             i, a, w, h, m, cores, ret;
+
+    seed = argc > 1 ? atoi(argv[1]) : BENCH_SEED;
+
+    /* Optional size of the environment, WxH. */
+    if (argc > 2 && (sscanf(argv[2], "%ix%i", &w, &h) != 2 ||
+                     !set_world_size(w, h, 0)))
+    {
+        fprintf(stderr, "Usage: %s [seed [WxH]]\n", argv[0]);
+        return 1;
+    }
+
+    headless_init();
+    generate_inputs(seed);
+
+    printf("{\"suite\":\"patriots\",\"seed\":%u,\"xwin\":%i,\"ywin\":%i,"
+           "\"n\":%i}\n", seed, xwin, ywin, N);
+
+    for (i = 0; i < sizeof(benchs) / sizeof(benchs[0]); i++)
+    {
+        run_bench(&benchs[i]);
+    }
+
+    /* Scenarios are seeded again so they do not depend on the above. */
+    for (a = 1; a <= N; a++)
+    {
+        srand(seed);
+        sprintf(name, "scenario_attackers_%i", a);
+        run_scenario(name, a, 1);
+    }
+
+    srand(seed);
+    run_scenario("scenario_salvo_burst", N, BENCH_SALVOS);
+
+    /* Workers double up to the online cores, for both layouts. */
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+    srand(seed);
+    for (m = BENCH_FS_MIN; m <= BENCH_FS_MAX; m *= 4)
+    {
+        for (w = 1; w <= cores && w <= m; w *= 2)
+        {
+            run_false_sharing(0, m, w);
+            run_false_sharing(1, m, w);
+        }
+    }
+
+    /* Only a bound exceeded with the environment fails the run. */
+    ret = run_inversion(0);
+    if (ret >= 0)
+    {
+        ret = run_inversion(1);
+    }
+    if (ret < 0)
+    {
+        printf("{\"name\":\"priority_inversion\",\"skipped\":"
+               "\"no real-time privileges\"}\n");
+        ret = 0;
+    }
+
+    return ret;
+}
@@ -0,0 +1,458 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the admission control of the missile tasks.
+ *
+ * Every running task is kept in the admitted set with its period,
+ * deadline and priority; a missile is added by the launcher before
+ * its task is created, and only if the set with the new missile
+ * passes the schedulability test:
+ * - fixed priority on a single CPU: response-time analysis, with the
+ *   tasks of equal priority (round robin) interfering with each other
+ *   and a task blocked at most once on the environment by a lower
+ *   priority one (priority inheritance), for at most its whole job;
+ * - fixed priority on m CPUs (global): utilisation bound for global
+ *   deadline monotonic, U <= m / 2 * (1 - Umax) + Umax;
+ * - EDF (SCHED_DEADLINE tasks only): density test for global EDF,
+ *   sum of C / min(D, T) <= m - (m - 1) * max density.
+ *
+ * The fixed priority tests are also used by the calibration on the
+ * measured task classes.
+ *
+ * The WCET of a task is the largest one measured (tstat) by the task
+ * itself, if running, or by the terminated tasks of its class. A
+ * missile that does not fit is degraded, doubling its period, and
+ * then refused: the launcher keeps it queued and tries again.
+ *
+********************************************************************/
+
+#include "admission.h"
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include "tstat.h"
+#include "gestor.h"
+#include "calib.h"
+
+// Task in the admitted set.
+typedef struct
+{
+    int             active;     // 1 if the slot is used.
+    task_class_t    task_class; // Class of the task.
+    int             task;       // Index of the task, NONE for a missile.
+    long            period;     // Period (us).
+    long            deadline;   // Relative deadline (us).
+    int             priority;   // Priority of the task.
+}   admitted_t;
+
+// Admission control.
+typedef struct
+{
+    int         enabled;                    // Admission control flag.
+    int         edf;                        // EDF test flag.
+    int         ncpus;                      // Number of CPUs.
+    admitted_t  slot[ADMISSION_SLOTS];      // Admitted tasks.
+    long        wcet[TASK_CLASSES];         // Measured WCET by class (us).
+    long        admitted;                   // Missiles admitted.
+    long        degraded;                   // Missiles admitted degraded.
+    long        refused;                    // Refused tests.
+    sem_t       mutex;                      // Mutex for the structure.
+}   admission_t;
+
+static admission_t          admission;
+
+// Class of the current task.
+static __thread task_class_t own_class;
+
+/*
+ * Initialize the admission control.
+ */
+void init_admission(int enabled, int edf)
+{
+    memset(&admission, 0, sizeof(admission));
+    admission.enabled = enabled;
+    admission.edf = edf;
+    admission.ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    sem_init(&admission.mutex, 0, 1);
+}
+
+/*
+ * Enable the measure of the execution time of a task.
+ */
+void admission_init_params(tpars *params)
+{
+    if (admission.enabled)
+    {
+        ptask_param_measure((*params));
+    }
+}
+
+/*
+ * Check if a class is a missile class.
+ *
+ * task_class: class of the task.
+ * ~return: 1 for the missile tasks, else 0.
+ */
+static int missile_class(task_class_t task_class)
+{
+    return task_class == ATK_MISSILE_TASK || task_class == DEF_MISSILE_TASK;
+}
+
+/*
+ * Get the WCET of an admitted task.
+ *
+ * a: reference to the admitted task.
+ * ~return: WCET (us).
+ */
+static long task_wcet(admitted_t *a)
+{
+    tspec   t;
+    long    wcet, own;
+
+    wcet = admission.wcet[a->task_class];
+    if (!wcet)
+    {
+        wcet = a->deadline * ADMISSION_INITIAL_LOAD;
+    }
+
+    if (a->task != NONE)
+    {
+        t = ptask_get_wcet(a->task);
+        own = tspec_to(&t, MICRO);
+        wcet = own > wcet ? own : wcet;
+    }
+
+    return wcet;
+}
+
+/*
+ * Update the period and deadline of a running task, that can change
+ * (adaptive display).
+ *
+ * a: reference to the admitted task.
+ */
+static void refresh_task(admitted_t *a)
+{
+    if (a->task != NONE)
+    {
+        a->period = ptask_get_period(a->task, MICRO);
+        a->deadline = ptask_get_deadline(a->task, MICRO);
+    }
+}
+
+/*
+ * Response-time analysis on a single CPU with fixed priorities, the
+ * tasks of equal priority (round robin) interfering with each other.
+ * A task is blocked at most once on the environment by a lower
+ * priority task (priority inheritance), for at most its whole job.
+ *
+ * set: tasks of the set.
+ * n: number of tasks.
+ * ~return: 1 if every task meets its deadline, else 0.
+ */
+static int response_time_test(sched_task_t *set, int n)
+{
+    long    r, prev, blocking;
+    int     i, j;
+
+    for (i = 0; i < n; i++)
+    {
+        blocking = 0;
+        for (j = 0; j < n; j++)
+        {
+            if (set[j].priority < set[i].priority && set[j].wcet > blocking)
+            {
+                blocking = set[j].wcet;
+            }
+        }
+
+        r = set[i].wcet + blocking;
+        do
+        {
+            prev = r;
+            r = set[i].wcet + blocking;
+            for (j = 0; j < n; j++)
+            {
+                if (j != i && set[j].priority >= set[i].priority)
+                {
+                    r += (long)ceil((double)prev / set[j].period) *
+                         set[j].wcet;
+                }
+            }
+        } while (r != prev && r <= set[i].deadline);
+
+        if (r > set[i].deadline)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Utilisation test on m CPUs with global deadline monotonic,
+ * U <= m / 2 * (1 - Umax) + Umax.
+ *
+ * set: tasks of the set.
+ * n: number of tasks.
+ * ncpus: number of CPUs.
+ * ~return: 1 if the set is schedulable, else 0.
+ */
+static int utilisation_test(sched_task_t *set, int n, int ncpus)
+{
+    double  u, sum, max;
+    int     i;
+
+    sum = max = 0;
+    for (i = 0; i < n; i++)
+    {
+        u = (double)set[i].wcet / set[i].period;
+        sum += u;
+        max = u > max ? u : max;
+    }
+
+    return sum <= ncpus / 2.0 * (1 - max) + max;
+}
+
+/*
+ * Test the schedulability of a task set with fixed priorities.
+ */
+int fixed_priority_test(sched_task_t *set, int n, int ncpus)
+{
+    if (ncpus > 1)
+    {
+        return utilisation_test(set, n, ncpus);
+    }
+    return response_time_test(set, n);
+}
+
+/*
+ * Density test of the admitted tasks with a new one, on m CPUs with
+ * global EDF.
+ *
+ * set: admitted tasks, with the new one.
+ * n: number of tasks.
+ * ~return: 1 if the set is schedulable, else 0.
+ */
+static int density_test(sched_task_t *set, int n)
+{
+    double  d, sum, max;
+    long    window;
+    int     i;
+
+    sum = max = 0;
+    for (i = 0; i < n; i++)
+    {
+        window = set[i].deadline < set[i].period ?
+                 set[i].deadline : set[i].period;
+        d = (double)set[i].wcet / window;
+        sum += d;
+        max = d > max ? d : max;
+    }
+
+    return sum <= admission.ncpus - (admission.ncpus - 1) * max;
+}
+
+/*
+ * Test the schedulability of the admitted tasks with a new one. Under
+ * EDF only the SCHED_DEADLINE tasks (missiles and display) are tested:
+ * they run before every fixed priority task.
+ *
+ * candidate: reference to the new task.
+ * ~return: 1 if the set is schedulable, else 0.
+ */
+static int schedulable(admitted_t *candidate)
+{
+    sched_task_t    set[ADMISSION_SLOTS + 1];
+    admitted_t      *a;
+    int             i, n;
+
+    n = 0;
+    for (i = 0; i <= ADMISSION_SLOTS; i++)
+    {
+        a = i < ADMISSION_SLOTS ? &(admission.slot[i]) : candidate;
+        if (!a->active && a != candidate)
+        {
+            continue;
+        }
+        if (admission.edf && !missile_class(a->task_class) &&
+            a->task_class != DISPLAY_TASK)
+        {
+            continue;
+        }
+
+        refresh_task(a);
+        set[n].wcet = task_wcet(a);
+        set[n].period = a->period;
+        set[n].deadline = a->deadline;
+        set[n].priority = a->priority;
+        n++;
+    }
+
+    if (admission.edf)
+    {
+        return density_test(set, n);
+    }
+    return fixed_priority_test(set, n, admission.ncpus);
+}
+
+/*
+ * Test the schedulability with a new missile and reserve its slot.
+ */
+int admit_missile(missile_type_t type, int index)
+{
+    admitted_t  *a;
+    int         stretch;
+
+    if (!admission.enabled)
+    {
+        return 1;
+    }
+
+    sem_wait(&admission.mutex);
+
+    a = &(admission.slot[MAX_TASKS + type * N + index]);
+    a->active = 0;
+    a->task = NONE;
+
+    if (type == ATTACKER)
+    {
+        a->task_class = ATK_MISSILE_TASK;
+    }
+    else
+    {
+        a->task_class = DEF_MISSILE_TASK;
+    }
+    a->priority = class_priority(a->task_class);
+
+    for (stretch = 1; stretch <= ADMISSION_MAX_STRETCH; stretch *= 2)
+    {
+        a->period = stretch * 1000L * class_period(a->task_class);
+        a->deadline = stretch * 1000L * class_deadline(a->task_class);
+
+        if (schedulable(a))
+        {
+            a->active = 1;
+            admission.admitted++;
+            admission.degraded += stretch > 1;
+            sem_post(&admission.mutex);
+            return stretch;
+        }
+    }
+
+    admission.refused++;
+
+    sem_post(&admission.mutex);
+
+    return 0;
+}
+
+/*
+ * Release the slot of a missile.
+ */
+void release_missile(missile_type_t type, int index)
+{
+    if (!admission.enabled)
+    {
+        return;
+    }
+
+    sem_wait(&admission.mutex);
+    admission.slot[MAX_TASKS + type * N + index].active = 0;
+    sem_post(&admission.mutex);
+}
+
+/*
+ * Add the current task to the admitted ones.
+ */
+void admission_task_start(task_class_t task_class)
+{
+    admitted_t  *a;
+    int         task;
+
+    own_class = task_class;
+
+    if (!admission.enabled || missile_class(task_class))
+    {
+        return;
+    }
+
+    task = ptask_get_index();
+
+    sem_wait(&admission.mutex);
+
+    a = &(admission.slot[task]);
+    a->task_class = task_class;
+    a->task = task;
+    a->priority = ptask_get_priority(task);
+    refresh_task(a);
+    a->active = 1;
+
+    sem_post(&admission.mutex);
+}
+
+/*
+ * Add the WCET of the current task to its class and remove it.
+ */
+void admission_task_end()
+{
+    tspec   t;
+    long    wcet;
+    int     task;
+
+    if (!admission.enabled)
+    {
+        return;
+    }
+
+    task = ptask_get_index();
+    t = ptask_get_wcet(task);
+    wcet = tspec_to(&t, MICRO);
+
+    sem_wait(&admission.mutex);
+
+    if (wcet > admission.wcet[own_class])
+    {
+        admission.wcet[own_class] = wcet;
+    }
+
+    if (!missile_class(own_class))
+    {
+        admission.slot[task].active = 0;
+    }
+
+    sem_post(&admission.mutex);
+}
+
+/*
+ * Print the decisions of the admission control.
+ */
+void print_admission_report(FILE *out)
+{
+    int c;
+
+    if (!admission.enabled)
+    {
+        return;
+    }
+
+    fprintf(out, "\n===== ADMISSION =====\n"
+                 "test: %s\n"
+                 "missiles admitted %li (%li degraded), refused tests %li\n",
+            admission.edf ? "EDF density" :
+            admission.ncpus > 1 ? "global DM utilisation bound" :
+            "response-time analysis",
+            admission.admitted, admission.degraded, admission.refused);
+
+    for (c = 0; c < TASK_CLASSES; c++)
+    {
+        if (admission.wcet[c])
+        {
+            fprintf(out, "%s: WCET %li us\n", task_class_name(c),
+                    admission.wcet[c]);
+        }
+    }
+}
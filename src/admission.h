@@ -0,0 +1,112 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the parameters of the admission control and the
+ * function prototypes necessary to admit the missile tasks before
+ * spawning them.
+ *
+********************************************************************/
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdio.h>
+
+#include "patriots.h"
+#include "launchers.h"
+#include "ptask.h"
+
+/********************************************************************
+ * ADMISSION PARAMETERS
+********************************************************************/
+
+// Slots of the admitted tasks: one for each task index, then one for
+// each missile (reserved before its task exists).
+#define ADMISSION_SLOTS         (MAX_TASKS + MISSILE_TYPES * N)
+// Fraction of the deadline assumed as WCET of a class not measured yet.
+#define ADMISSION_INITIAL_LOAD  0.05
+// Maximum stretch of the period (and deadline) of a degraded missile.
+#define ADMISSION_MAX_STRETCH   4
+
+// Task of a schedulability test.
+typedef struct
+{
+    long    wcet;       // Worst case execution time (us).
+    long    period;     // Period (us).
+    long    deadline;   // Relative deadline (us).
+    int     priority;   // Fixed priority.
+}   sched_task_t;
+
+/*
+ * Initialize the admission control.
+ *
+ * enabled: 1 to test the schedulability before spawning a missile.
+ * edf: 1 if the missile and display tasks run under SCHED_DEADLINE.
+ */
+void init_admission(int enabled, int edf);
+
+/*
+ * Enable the measure of the execution time in the parameters of a
+ * task: its WCET is used by the schedulability tests.
+ *
+ * params: reference to the parameters of the task.
+ */
+void admission_init_params(tpars *params);
+
+/*
+ * Test the schedulability of the admitted tasks with a new missile
+ * and reserve its slot: first with its nominal period, then degraded
+ * with the period and the deadline doubled, up to
+ * ADMISSION_MAX_STRETCH. Always admitted if not enabled.
+ *
+ * type: type of the missile.
+ * index: index of the missile in its queue.
+ * ~return: stretch of the period of the missile (1 if nominal), 0 if
+ * the missile is not admitted.
+ */
+int admit_missile(missile_type_t type, int index);
+
+/*
+ * Release the slot of a missile, at its end or if it is not launched.
+ *
+ * type: type of the missile.
+ * index: index of the missile in its queue.
+ */
+void release_missile(missile_type_t type, int index);
+
+/*
+ * Add the current task to the admitted ones (missiles are already
+ * added by admit_missile).
+ *
+ * task_class: class of the current task.
+ */
+void admission_task_start(task_class_t task_class);
+
+/*
+ * Add the WCET measured by the current task to its class and remove
+ * it from the admitted tasks (missiles are removed by
+ * release_missile).
+ */
+void admission_task_end();
+
+/*
+ * Test the schedulability of a task set with fixed priorities: the
+ * response-time analysis on a single CPU, else the utilisation bound
+ * of global deadline monotonic on m CPUs. Used by the admission
+ * control and by the calibration.
+ *
+ * set: tasks of the set.
+ * n: number of tasks.
+ * ncpus: number of CPUs.
+ * ~return: 1 if the set is schedulable, else 0.
+ */
+int fixed_priority_test(sched_task_t *set, int n, int ncpus);
+
+/*
+ * Print the decisions of the admission control, if enabled.
+ *
+ * out: stream where the report is written.
+ */
+void print_admission_report(FILE *out);
+
+#endif
@@ -0,0 +1,567 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the task parameters and their calibration.
+ *
+ * The period, deadline and priority of the display manager, of the
+ * launchers and of the missiles are read from a table, initialized with
+ * the parameters of the headers and changed by a task parameters file
+ * loaded at the start. The other tasks (mode manager, scenario loader,
+ * tiles, wheel dispatchers) keep the parameters of the headers.
+ *
+ * A calibration run measures the execution time of every job (thread
+ * CPU time, as tstat does) and keeps the longest one of each class. At
+ * the end the configurable classes get:
+ * - deadline monotonic priorities, from CALIB_MAX_PRIO for the shortest
+ *   deadline down to CALIB_MIN_PRIO, shared by the longest deadlines
+ *   when the levels are not enough;
+ * - the smallest factor of their current periods and deadlines,
+ *   from CALIB_MIN_SCALE up by CALIB_SCALE_STEP, that keeps the set
+ *   schedulable with the WCET increased by CALIB_WCET_MARGIN: N tasks
+ *   for each missile class, the largest number of tasks seen for the
+ *   other classes. The set is tested by the fixed priority test of
+ *   the admission control (fixed_priority_test): response-time
+ *   analysis on a single CPU (with the blocking on the environment),
+ *   utilisation bound of global deadline monotonic on more CPUs.
+ * The result is written as a task parameters file. The missiles run by
+ * the wheel dispatchers are not jobs of a task and are not measured,
+ * so a calibration runs the missile tasks.
+ *
+********************************************************************/
+
+#include "calib.h"
+#include <time.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include "ptask.h"
+#include "gestor.h"
+#include "launchers.h"
+#include "scenario.h"
+#include "opmode.h"
+#include "wheel.h"
+#include "admission.h"
+
+// Parameters of a task class.
+typedef struct
+{
+    int     period;     // Period (ms).
+    int     deadline;   // Relative deadline (ms).
+    int     priority;   // Fixed priority.
+}   class_params_t;
+
+// Calibration.
+typedef struct
+{
+    char    *path;                      // Output file, NULL if disabled.
+    int     ncpus;                      // Number of CPUs.
+    long    wcet[TASK_CLASSES];         // Longest job by class (ns).
+    long    jobs[TASK_CLASSES];         // Measured jobs by class.
+    long    running[TASK_CLASSES];      // Running tasks by class.
+    long    instances[TASK_CLASSES];    // Most running tasks by class.
+}   calib_t;
+
+// Task parameters by class, from the headers unless loaded from file.
+static class_params_t   params[TASK_CLASSES] = {
+    {DISPLAY_PERIOD,        DISPLAY_DEADLINE,       DISPLAY_PRIO},
+    {ATK_LAUNCHER_PERIOD,   ATK_LAUNCHER_PERIOD,    ATK_LAUNCHER_PRIO},
+    {ATK_MISSILE_PERIOD,    ATK_MISSILE_DEADLINE,   ATK_MISSILE_PRIO},
+    {DEF_LAUNCHER_PERIOD,   DEF_LAUNCHER_PERIOD,    DEF_LAUNCHER_PRIO},
+    {DEF_MISSILE_PERIOD,    DEF_MISSILE_DEADLINE,   DEF_MISSILE_PRIO},
+    {SCENARIO_PERIOD,       SCENARIO_PERIOD,        SCENARIO_PRIO},
+    {DISPLAY_PERIOD,        DISPLAY_PERIOD,         TILE_PRIO},
+    {MODE_PERIOD,           MODE_PERIOD,            MODE_PRIO},
+    {WHEEL_TICK,            WHEEL_TICK,             WHEEL_PRIO}
+};
+
+static calib_t          calib;
+
+// Class of the current task.
+static __thread task_class_t    own_class;
+// Execution time of the current task at the end of its last job (ns).
+static __thread long            own_busy;
+
+/********************************************************************
+ * TASK PARAMETERS
+********************************************************************/
+
+/*
+ * Check if the parameters of a class are configurable.
+ *
+ * task_class: class of the task.
+ * ~return: 1 for the display manager, launchers and missiles, else 0.
+ */
+static int tuned_class(task_class_t task_class)
+{
+    return task_class == DISPLAY_TASK ||
+           task_class == ATK_LAUNCHER_TASK || task_class == ATK_MISSILE_TASK ||
+           task_class == DEF_LAUNCHER_TASK || task_class == DEF_MISSILE_TASK;
+}
+
+/*
+ * Find a configurable class by name.
+ *
+ * name: name of the class.
+ * ~return: class of the task, NONE if not configurable.
+ */
+static int find_class(char *name)
+{
+    int c;
+
+    for (c = 0; c < TASK_CLASSES; c++)
+    {
+        if (tuned_class(c) && strcmp(name, task_class_name(c)) == 0)
+        {
+            return c;
+        }
+    }
+
+    return NONE;
+}
+
+/*
+ * Parse a single line of the task parameters file.
+ *
+ * line: line to parse.
+ * ~return: 1 if the line is valid, else 0.
+ */
+static int parse_line(char *line)
+{
+    char            name[CALIB_LINE_LEN];
+    class_params_t  p;
+    int             c, offset;
+
+    if (sscanf(line, "%s%n", name, &offset) != 1 || name[0] == '#')
+    {
+        return 1;   // Empty line or comment.
+    }
+
+    c = find_class(name);
+    if (c == NONE || sscanf(line + offset, "%i %i %i", &p.period,
+                            &p.deadline, &p.priority) != 3)
+    {
+        return 0;
+    }
+
+    if (p.deadline < 1 || p.deadline > p.period ||
+        p.period > CALIB_MAX_PERIOD ||
+        p.priority < CALIB_MIN_PRIO || p.priority > CALIB_MAX_PRIO)
+    {
+        return 0;
+    }
+
+    params[c] = p;
+
+    return 1;
+}
+
+/*
+ * Load the task parameters file.
+ */
+int load_task_params(char *path)
+{
+    FILE    *f;
+    char    line[CALIB_LINE_LEN];
+    int     n, ret;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror("CALIB: Unable to open the task parameters file");
+        return 0;
+    }
+
+    ret = 1;
+    for (n = 1; ret && fgets(line, CALIB_LINE_LEN, f) != NULL; n++)
+    {
+        ret = parse_line(line);
+        if (!ret)
+        {
+            fprintf(stderr, "CALIB: Invalid line %i: %s", n, line);
+        }
+    }
+
+    fclose(f);
+
+    return ret;
+}
+
+/*
+ * Get the period of the tasks of a class.
+ */
+int class_period(task_class_t task_class)
+{
+    return params[task_class].period;
+}
+
+/*
+ * Get the relative deadline of the tasks of a class.
+ */
+int class_deadline(task_class_t task_class)
+{
+    return params[task_class].deadline;
+}
+
+/*
+ * Get the priority of the tasks of a class.
+ */
+int class_priority(task_class_t task_class)
+{
+    return params[task_class].priority;
+}
+
+/********************************************************************
+ * MEASURE
+********************************************************************/
+
+/*
+ * Initialize the calibration.
+ */
+void init_calib(char *path)
+{
+    memset(&calib, 0, sizeof(calib));
+    calib.path = path;
+    calib.ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+/*
+ * Read a clock.
+ *
+ * clock: clock to read.
+ * ~return: time of the clock (ns).
+ */
+static long clock_ns(clockid_t clock)
+{
+    struct timespec t;
+
+    clock_gettime(clock, &t);
+
+    return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+/*
+ * Raise a value to a new one, if greater.
+ *
+ * value: reference to the value.
+ * candidate: new value.
+ */
+static void raise_to(long *value, long candidate)
+{
+    long    old;
+
+    old = __atomic_load_n(value, __ATOMIC_RELAXED);
+    while (candidate > old &&
+           !__atomic_compare_exchange_n(value, &old, candidate, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        ;
+    }
+}
+
+/*
+ * Count the current task in its class.
+ */
+void calib_task_start(task_class_t task_class)
+{
+    long    running;
+
+    if (calib.path == NULL)
+    {
+        return;
+    }
+
+    own_class = task_class;
+
+    running = __atomic_add_fetch(&calib.running[task_class], 1,
+                                 __ATOMIC_RELAXED);
+    raise_to(&calib.instances[task_class], running);
+
+    /* The prefault of the stack is not part of the first job. */
+    own_busy = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+/*
+ * Remove the current task from its class.
+ */
+void calib_task_end()
+{
+    if (calib.path != NULL)
+    {
+        __atomic_fetch_sub(&calib.running[own_class], 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Measure the execution time of the current job.
+ */
+void calib_job_end()
+{
+    long    busy;
+
+    if (calib.path == NULL)
+    {
+        return;
+    }
+
+    busy = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    raise_to(&calib.wcet[own_class], busy - own_busy);
+    __atomic_fetch_add(&calib.jobs[own_class], 1, __ATOMIC_RELAXED);
+    own_busy = busy;
+}
+
+/********************************************************************
+ * ANALYSIS
+********************************************************************/
+
+/*
+ * Assign deadline monotonic priorities to the configurable classes:
+ * every shorter deadline is one level higher.
+ *
+ * p: parameters of every class.
+ */
+static void assign_priorities(class_params_t *p)
+{
+    int c, j, k, rank, seen;
+
+    for (c = 0; c < TASK_CLASSES; c++)
+    {
+        if (!tuned_class(c))
+        {
+            continue;
+        }
+
+        /* Rank: distinct deadlines shorter than the one of the class. */
+        rank = 0;
+        for (j = 0; j < TASK_CLASSES; j++)
+        {
+            if (!tuned_class(j) || p[j].deadline >= p[c].deadline)
+            {
+                continue;
+            }
+
+            seen = 0;
+            for (k = 0; k < j; k++)
+            {
+                seen |= tuned_class(k) && p[k].deadline == p[j].deadline;
+            }
+            rank += !seen;
+        }
+
+        p[c].priority = CALIB_MAX_PRIO - rank < CALIB_MIN_PRIO ?
+                        CALIB_MIN_PRIO : CALIB_MAX_PRIO - rank;
+    }
+}
+
+/*
+ * Scale the periods and the deadlines of the configurable classes.
+ *
+ * p: parameters of every class, scaled from the current ones.
+ * scale: factor of the periods and deadlines.
+ */
+static void scale_params(class_params_t *p, double scale)
+{
+    int c;
+
+    for (c = 0; c < TASK_CLASSES; c++)
+    {
+        if (tuned_class(c))
+        {
+            p[c].period = (int)lround(scale * params[c].period);
+            p[c].deadline = (int)lround(scale * params[c].deadline);
+            p[c].period = p[c].period < 1 ? 1 : p[c].period;
+            p[c].deadline = p[c].deadline < 1 ? 1 : p[c].deadline;
+        }
+    }
+
+    /* The tiles render the frames of the display manager. */
+    p[TILE_TASK].period = p[TILE_TASK].deadline = p[DISPLAY_TASK].period;
+}
+
+/*
+ * Get the number of tasks of a class in the analysed set.
+ *
+ * task_class: class of the task.
+ * ~return: N for the missiles, else the most tasks seen running.
+ */
+static long class_instances(task_class_t task_class)
+{
+    if (task_class == ATK_MISSILE_TASK || task_class == DEF_MISSILE_TASK)
+    {
+        return N;
+    }
+
+    return calib.instances[task_class];
+}
+
+/*
+ * Build the analysed set with the measured classes.
+ *
+ * p: parameters of every class.
+ * set: array of MAX_TASKS tasks to fill.
+ * ~return: number of tasks.
+ */
+static int build_set(class_params_t *p, sched_task_t *set)
+{
+    long    wcet;
+    int     c, i, n;
+
+    n = 0;
+    for (c = 0; c < TASK_CLASSES; c++)
+    {
+        if (!calib.jobs[c])
+        {
+            continue;
+        }
+
+        wcet = (long)(calib.wcet[c] * CALIB_WCET_MARGIN / 1000);
+
+        for (i = 0; i < class_instances(c) && n < MAX_TASKS; i++)
+        {
+            set[n].wcet = wcet > 0 ? wcet : 1;
+            set[n].period = p[c].period * 1000L;
+            set[n].deadline = p[c].deadline * 1000L;
+            set[n].priority = p[c].priority;
+            n++;
+        }
+    }
+
+    return n;
+}
+
+/*
+ * Test the schedulability of the measured classes.
+ *
+ * p: parameters of every class.
+ * ~return: 1 if the set is schedulable, else 0.
+ */
+static int schedulable(class_params_t *p)
+{
+    sched_task_t    set[MAX_TASKS];
+    int             n;
+
+    n = build_set(p, set);
+
+    return fixed_priority_test(set, n, calib.ncpus);
+}
+
+/*
+ * Find the smallest factor of the periods that keeps the measured
+ * classes schedulable, with deadline monotonic priorities.
+ *
+ * p: parameters of every class, with the proposed ones.
+ * ~return: factor of the periods, 0 if none is schedulable.
+ */
+static double propose_params(class_params_t *p)
+{
+    double  scale;
+    int     k, steps;
+
+    memcpy(p, params, sizeof(params));
+
+    steps = (int)lround((CALIB_MAX_SCALE - CALIB_MIN_SCALE) /
+                        CALIB_SCALE_STEP);
+    for (k = 0; k <= steps; k++)
+    {
+        scale = CALIB_MIN_SCALE + k * CALIB_SCALE_STEP;
+        scale_params(p, scale);
+        assign_priorities(p);
+
+        if (schedulable(p))
+        {
+            return scale;
+        }
+    }
+
+    memcpy(p, params, sizeof(params));
+
+    return 0;
+}
+
+/*
+ * Write the parameters of the configurable classes on a task parameters
+ * file.
+ *
+ * p: parameters of every class.
+ * scale: factor of the periods.
+ * ~return: 1 on success, else 0.
+ */
+static int write_task_params(class_params_t *p, double scale)
+{
+    FILE    *f;
+    int     c;
+
+    f = fopen(calib.path, "w");
+    if (f == NULL)
+    {
+        perror("CALIB: Unable to write the task parameters file");
+        return 0;
+    }
+
+    fprintf(f, "# Task parameters calibrated on %i CPUs, periods x%.2f\n"
+               "# class period deadline priority\n", calib.ncpus, scale);
+
+    for (c = 0; c < TASK_CLASSES; c++)
+    {
+        if (tuned_class(c))
+        {
+            fprintf(f, "%s %i %i %i\n", task_class_name(c),
+                    p[c].period, p[c].deadline, p[c].priority);
+        }
+    }
+
+    fclose(f);
+
+    return 1;
+}
+
+/*
+ * Print the measured WCET and the proposed parameters of every class.
+ */
+void print_calib_report(FILE *out)
+{
+    class_params_t  p[TASK_CLASSES];
+    double          scale;
+    int             c;
+
+    if (calib.path == NULL)
+    {
+        return;
+    }
+
+    scale = propose_params(p);
+
+    fprintf(out, "\n===== CALIBRATION =====\n");
+
+    for (c = 0; c < TASK_CLASSES; c++)
+    {
+        if (!calib.jobs[c] && !tuned_class(c))
+        {
+            continue;
+        }
+
+        fprintf(out, "%s: jobs %li, wcet %li us", task_class_name(c),
+                calib.jobs[c], calib.wcet[c] / 1000);
+        if (tuned_class(c))
+        {
+            fprintf(out, ", period %i -> %i ms, deadline %i -> %i ms, "
+                         "priority %i -> %i",
+                    params[c].period, p[c].period,
+                    params[c].deadline, p[c].deadline,
+                    params[c].priority, p[c].priority);
+        }
+        fprintf(out, "\n");
+    }
+
+    if (!scale)
+    {
+        fprintf(out, "not schedulable up to periods x%.2f, %s not written\n",
+                CALIB_MAX_SCALE, calib.path);
+        return;
+    }
+
+    if (write_task_params(p, scale))
+    {
+        fprintf(out, "periods x%.2f, written on %s\n", scale, calib.path);
+    }
+}
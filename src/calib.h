@@ -0,0 +1,114 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the parameters of the calibration and the
+ * function prototypes necessary to read the period, deadline and
+ * priority of the tasks, to load them from file and to propose them
+ * from the execution times measured by a run.
+ *
+********************************************************************/
+
+#ifndef CALIB_H
+#define CALIB_H
+
+#include <stdio.h>
+
+#include "patriots.h"
+
+/********************************************************************
+ * CALIBRATION PARAMETERS
+********************************************************************/
+
+// Lowest priority assigned to the configurable tasks.
+#define CALIB_MIN_PRIO          1
+// Highest priority assigned to the configurable tasks, below the mode
+// manager.
+#define CALIB_MAX_PRIO          3
+// Longest period (and deadline) of a configurable task (ms).
+#define CALIB_MAX_PERIOD        1000
+// Margin of the WCET used by the analysis over the measured one.
+#define CALIB_WCET_MARGIN       1.25
+// Smallest and largest factor of the current periods tried by the
+// calibration, and the step between two factors.
+#define CALIB_MIN_SCALE         0.25
+#define CALIB_MAX_SCALE         8.0
+#define CALIB_SCALE_STEP        0.05
+// Maximum length of a line of the task parameters file.
+#define CALIB_LINE_LEN          128
+
+/*
+ * Initialize the calibration. The task parameters loaded by
+ * load_task_params are kept.
+ *
+ * path: file where the proposed task parameters are written at the
+ * end, NULL if the run is not a calibration.
+ */
+void init_calib(char *path);
+
+/*
+ * Load the period, deadline and priority of the configurable tasks
+ * (display manager, launchers and missiles) from a file with a line
+ * "<class> <period> <deadline> <priority>" for each task class to
+ * change (empty lines and lines starting with '#' are ignored). The
+ * other classes keep the parameters of the headers.
+ *
+ * path: path of the task parameters file.
+ * ~return: 1 if the file is valid, else 0.
+ */
+int load_task_params(char *path);
+
+/*
+ * Get the period of the tasks of a class.
+ *
+ * task_class: class of the task.
+ * ~return: period (ms).
+ */
+int class_period(task_class_t task_class);
+
+/*
+ * Get the relative deadline of the tasks of a class.
+ *
+ * task_class: class of the task.
+ * ~return: relative deadline (ms).
+ */
+int class_deadline(task_class_t task_class);
+
+/*
+ * Get the priority of the tasks of a class.
+ *
+ * task_class: class of the task.
+ * ~return: fixed priority.
+ */
+int class_priority(task_class_t task_class);
+
+/*
+ * Count the current task in its class and start the measure of its
+ * first job. Called at the start of the body of every task.
+ *
+ * task_class: class of the task.
+ */
+void calib_task_start(task_class_t task_class);
+
+/*
+ * Remove the current task from its class. Called at the end of the
+ * body of every task.
+ */
+void calib_task_end();
+
+/*
+ * Measure the execution time of the current job. Called at the end of
+ * every job.
+ */
+void calib_job_end();
+
+/*
+ * Assign the deadline monotonic priorities and the smallest periods
+ * that keep the measured task set schedulable, write them on the file
+ * of the calibration and print them. Nothing is done if the run is not
+ * a calibration.
+ *
+ * out: stream where the report is written.
+ */
+void print_calib_report(FILE *out);
+
+#endif
@@ -0,0 +1,156 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the coroutines of the missile bodies.
+ *
+ * A missile body keeps its form of periodic task, a loop around
+ * task_wait_for_period, but runs as a coroutine (ucontext) on its own
+ * stack instead of a thread: the coroutine is an entry of the timer
+ * wheels, so at every period of the missile a dispatcher task resumes
+ * it, and task_wait_for_period switches back to the dispatcher. The
+ * entry of a coroutine always belongs to the same dispatcher, so its
+ * thread-local state (tracer, environment priority) stays consistent.
+ *
+ * The stacks are allocated once, at the initialization, and a body
+ * that blocks (environment, queues) blocks its dispatcher. A body that
+ * returns is still on its stack until it yields for good, so whatever
+ * lets its identifier be spawned again (the index of the missile) is
+ * released by the end function, run by the dispatcher after it.
+ *
+********************************************************************/
+
+#include "coro.h"
+#include <string.h>
+#include <assert.h>
+#include <ucontext.h>
+#include "wheel.h"
+
+// Missile coroutine.
+typedef struct
+{
+    ucontext_t    context;              // Context of the body.
+    ucontext_t    caller;               // Context of the dispatcher.
+    coro_fn_t     body;                 // Body of the coroutine.
+    coro_end_fn_t end;                  // Run after the body returned.
+    void          *arg;                 // Argument of the body.
+    int           period;               // Period of the wheel (ms).
+    int           done;                 // 1 when the body returned.
+    char          stack[CORO_STACK];    // Stack of the body.
+}   coro_t;
+
+// Coroutines of the missiles.
+typedef struct
+{
+    int     enabled;                    // Coroutines flag.
+    coro_t  coro[CORO_MAX];             // Coroutines by identifier.
+}   coros_t;
+
+static coros_t              coros;
+
+// Coroutine run by the current thread, NULL if none.
+static __thread coro_t      *own_coro;
+
+/*
+ * Initialize the coroutines.
+ */
+void init_coro(int enabled)
+{
+    memset(&coros, 0, sizeof(coros));
+    coros.enabled = enabled;
+}
+
+/*
+ * Entry point of a coroutine: runs its body and yields for good.
+ */
+static void coro_main()
+{
+    coro_t  *c;
+
+    c = own_coro;
+    c->body(c->arg, c->period);
+
+    c->done = 1;
+    coro_yield();
+}
+
+/*
+ * Resume a coroutine until it yields, as the function of its wheel
+ * entry, and run its end function once its body returned.
+ *
+ * arg: reference to the coroutine.
+ * period: period of the entry (ms), passed to the body at its start.
+ * ~return: 1 if the body returned, else 0.
+ */
+static int coro_resume(void *arg, int period)
+{
+    coro_t  *c;
+    int     done;
+
+    c = arg;
+    c->period = period;
+
+    own_coro = c;
+    swapcontext(&c->caller, &c->context);
+    own_coro = NULL;
+
+    /* Out of the stack of the body: the coroutine can be reused, so
+       it is not read after the end function. */
+    done = c->done;
+    if (done)
+    {
+        c->end(c->arg);
+    }
+
+    return done;
+}
+
+/*
+ * Start a coroutine on a wheel dispatcher.
+ */
+int coro_spawn(int id, int period, coro_fn_t body, coro_end_fn_t end,
+               void *arg)
+{
+    coro_t  *c;
+
+    if (!coros.enabled)
+    {
+        return -1;
+    }
+
+    assert(id >= 0 && id < CORO_MAX);
+
+    c = &(coros.coro[id]);
+    c->body = body;
+    c->end = end;
+    c->arg = arg;
+    c->done = 0;
+
+    getcontext(&c->context);
+    c->context.uc_stack.ss_sp = c->stack;
+    c->context.uc_stack.ss_size = sizeof(c->stack);
+    c->context.uc_link = NULL;
+    makecontext(&c->context, coro_main, 0);
+
+    return wheel_add(id, period, coro_resume, c);
+}
+
+/*
+ * Check if the current thread runs a coroutine.
+ */
+int in_coro()
+{
+    return own_coro != NULL;
+}
+
+/*
+ * Yield the current coroutine to its dispatcher.
+ */
+void coro_yield()
+{
+    coro_t  *c;
+
+    c = own_coro;
+    assert(c != NULL);
+
+    swapcontext(&c->context, &c->caller);
+}
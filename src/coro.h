@@ -0,0 +1,81 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the parameters of the missile coroutines and the
+ * function prototypes necessary to run the missile bodies on the
+ * wheel dispatcher tasks.
+ *
+********************************************************************/
+
+#ifndef CORO_H
+#define CORO_H
+
+#include "patriots.h"
+#include "launchers.h"
+
+/********************************************************************
+ * COROUTINE PARAMETERS
+********************************************************************/
+
+// Coroutines: one for each missile.
+#define CORO_MAX            (MISSILE_TYPES * N)
+// Stack of a coroutine (bytes).
+#define CORO_STACK          (64 * 1024)
+
+/*
+ * Body of a coroutine, written as the body of a periodic task: every
+ * task_wait_for_period yields to the dispatcher until the next period.
+ *
+ * arg: argument of the coroutine.
+ * period: period of the coroutine (ms).
+ */
+typedef void (*coro_fn_t)(void *arg, int period);
+
+/*
+ * Function run by the dispatcher once the body of a coroutine returned,
+ * out of its stack: the coroutine can be spawned again from here.
+ *
+ * arg: argument of the coroutine.
+ */
+typedef void (*coro_end_fn_t)(void *arg);
+
+/*
+ * Initialize the coroutines. The wheel dispatchers must be enabled
+ * too: they run the coroutines.
+ *
+ * enabled: 1 to run the missile bodies as coroutines, else 0.
+ */
+void init_coro(int enabled);
+
+/*
+ * Start a coroutine on a wheel dispatcher, resumed at every period from
+ * the next tick aligned on it, until its body returns. The identifier
+ * must not be spawned again before the end function is run.
+ *
+ * id: identifier of the coroutine (and of its wheel entry), from 0 to
+ * CORO_MAX - 1.
+ * period: period of the coroutine (ms).
+ * body: body of the coroutine, with the period of the wheel (rounded
+ * up to its ticks).
+ * end: function run after the body returned.
+ * arg: argument of the body and of the end function.
+ * ~return: 0 on success, -1 if not enabled (the caller runs its own
+ * task).
+ */
+int coro_spawn(int id, int period, coro_fn_t body, coro_end_fn_t end,
+               void *arg);
+
+/*
+ * Check if the current thread runs a coroutine.
+ *
+ * ~return: 1 inside the body of a coroutine, else 0.
+ */
+int in_coro();
+
+/*
+ * Yield the current coroutine to its dispatcher, until its next
+ * period. Must be called inside the body of a coroutine.
+ */
+void coro_yield();
+
+#endif
@@ -0,0 +1,232 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the EDF execution mode.
+ *
+ * The library is still initialized with fixed priorities: every task
+ * is created with its priority and the missile and display tasks move
+ * themselves under SCHED_DEADLINE at their start (sched_setattr), with
+ * their period and deadline. If the kernel refuses the reservation
+ * the task keeps its fixed priority, so an admission failure degrades
+ * a single task instead of losing it.
+ *
+ * The runtime is derived from the largest WCET measured (tstat) by the
+ * terminated tasks of the same class, with a margin; until a task of
+ * the class ends, a fraction of the deadline is reserved.
+ *
+********************************************************************/
+
+#include "libdl.h"
+#include "edf.h"
+#include <stdint.h>
+#include <string.h>
+#include "tstat.h"
+#include "gestor.h"
+
+// Reservations of a task class.
+typedef struct
+{
+    long        wcet;       // Largest measured WCET (us), 0 if unknown.
+    uint64_t    admitted;   // Tasks run under SCHED_DEADLINE.
+    uint64_t    rejected;   // Tasks refused by the kernel.
+}   edf_class_t;
+
+// EDF execution mode.
+typedef struct
+{
+    int         enabled;                    // EDF mode flag.
+    edf_class_t task_class[TASK_CLASSES];   // Reservations by class.
+}   edf_t;
+
+static edf_t                edf;
+
+// 1 if the current task runs under SCHED_DEADLINE.
+static __thread int         own_edf;
+// Class of the current task.
+static __thread task_class_t own_class;
+
+/*
+ * Initialize the EDF execution mode.
+ */
+void init_edf(int enabled)
+{
+    memset(&edf, 0, sizeof(edf));
+    edf.enabled = enabled;
+}
+
+/*
+ * Check if the tasks of a class run under SCHED_DEADLINE.
+ *
+ * task_class: class of the task.
+ * ~return: 1 for the missile and display tasks, else 0.
+ */
+static int edf_class(task_class_t task_class)
+{
+    return task_class == DISPLAY_TASK || task_class == ATK_MISSILE_TASK ||
+           task_class == DEF_MISSILE_TASK;
+}
+
+/*
+ * Enable the measure of the execution time of a task.
+ */
+void edf_init_params(tpars *params)
+{
+    if (edf.enabled)
+    {
+        ptask_param_measure((*params));
+    }
+}
+
+/*
+ * Get the runtime to reserve to the current task: its own WCET, if
+ * already measured, or the one of its class, with a margin.
+ *
+ * deadline: relative deadline of the task (us).
+ * ~return: runtime (us), from EDF_MIN_RUNTIME to the deadline.
+ */
+static long task_runtime(long deadline)
+{
+    tspec   t;
+    long    wcet, t_class, runtime;
+
+    t = ptask_get_wcet(ptask_get_index());
+    wcet = tspec_to(&t, MICRO);
+
+    t_class = __atomic_load_n(&edf.task_class[own_class].wcet,
+                              __ATOMIC_RELAXED);
+    wcet = wcet < t_class ? t_class : wcet;
+
+    runtime = wcet ? wcet * EDF_WCET_MARGIN : deadline * EDF_INITIAL_LOAD;
+
+    runtime = runtime < EDF_MIN_RUNTIME ? EDF_MIN_RUNTIME : runtime;
+    runtime = runtime > deadline ? deadline : runtime;
+
+    return runtime;
+}
+
+/*
+ * Set the SCHED_DEADLINE reservation of the current thread.
+ *
+ * runtime: runtime (us).
+ * deadline: relative deadline (us).
+ * period: period (us).
+ * ~return: 0 on success, -1 if refused by the kernel.
+ */
+static int set_reservation(long runtime, long deadline, long period)
+{
+    struct sched_attr   attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_runtime = runtime * 1000ULL;
+    attr.sched_deadline = deadline * 1000ULL;
+    attr.sched_period = period * 1000ULL;
+
+    return sched_setattr(0, &attr, 0);
+}
+
+/*
+ * Move the current task under SCHED_DEADLINE.
+ */
+void edf_task_start(task_class_t task_class)
+{
+    long    period, deadline;
+    int     task;
+
+    own_edf = 0;
+    own_class = task_class;
+
+    if (!edf.enabled || !edf_class(task_class))
+    {
+        return;
+    }
+
+    task = ptask_get_index();
+    period = ptask_get_period(task, MICRO);
+    deadline = ptask_get_deadline(task, MICRO);
+
+    if (set_reservation(task_runtime(deadline), deadline, period) != 0)
+    {
+        __atomic_fetch_add(&edf.task_class[task_class].rejected, 1,
+                           __ATOMIC_RELAXED);
+        return;
+    }
+
+    own_edf = 1;
+    __atomic_fetch_add(&edf.task_class[task_class].admitted, 1,
+                       __ATOMIC_RELAXED);
+}
+
+/*
+ * Change the period of the reservation of the current task.
+ */
+void edf_set_period(int period)
+{
+    long    us;
+
+    if (!own_edf)
+    {
+        return;
+    }
+
+    /* On failure the kernel keeps the previous reservation. */
+    us = period * 1000L;
+    set_reservation(task_runtime(us), us, us);
+}
+
+/*
+ * Add the WCET measured by the current task to its class.
+ */
+void edf_task_end()
+{
+    tspec   t;
+    long    wcet, old;
+
+    if (!edf.enabled || !edf_class(own_class))
+    {
+        return;
+    }
+
+    t = ptask_get_wcet(ptask_get_index());
+    wcet = tspec_to(&t, MICRO);
+
+    old = __atomic_load_n(&edf.task_class[own_class].wcet, __ATOMIC_RELAXED);
+    while (wcet > old &&
+           !__atomic_compare_exchange_n(&edf.task_class[own_class].wcet, &old,
+                                        wcet, 0, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED))
+    {
+        /* old is updated by the failed exchange. */
+    }
+}
+
+/*
+ * Print the reservations of each task class.
+ */
+void print_edf_report(FILE *out)
+{
+    edf_class_t *c;
+    int         t;
+
+    if (!edf.enabled)
+    {
+        return;
+    }
+
+    fprintf(out, "\n===== EDF =====\n");
+
+    for (t = 0; t < TASK_CLASSES; t++)
+    {
+        c = &(edf.task_class[t]);
+        if (!edf_class(t) || !(c->admitted + c->rejected))
+        {
+            continue;
+        }
+
+        fprintf(out, "%s: %llu tasks under SCHED_DEADLINE, %llu refused "
+                     "(fixed priority), WCET %li us\n",
+                task_class_name(t), (unsigned long long)c->admitted,
+                (unsigned long long)c->rejected, c->wcet);
+    }
+}
@@ -0,0 +1,78 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the parameters of the EDF execution mode and the
+ * function prototypes necessary to run the missile and display tasks
+ * under SCHED_DEADLINE.
+ *
+********************************************************************/
+
+#ifndef EDF_H
+#define EDF_H
+
+#include <stdio.h>
+
+#include "patriots.h"
+#include "ptask.h"
+
+/********************************************************************
+ * EDF PARAMETERS
+********************************************************************/
+
+// Fraction of the deadline reserved to a task class not measured yet.
+#define EDF_INITIAL_LOAD    0.25
+// Margin of the reserved runtime over the measured WCET.
+#define EDF_WCET_MARGIN     1.5
+// Minimum reserved runtime (us).
+#define EDF_MIN_RUNTIME     100
+
+/*
+ * Initialize the EDF execution mode. Must be called before any task
+ * is created.
+ *
+ * enabled: 1 to run the missile and display tasks under
+ * SCHED_DEADLINE, else 0.
+ */
+void init_edf(int enabled);
+
+/*
+ * Enable the measure of the execution time in the parameters of a
+ * task that may run under SCHED_DEADLINE: its WCET sizes the runtime
+ * of the next tasks of its class.
+ *
+ * params: reference to the parameters of the task.
+ */
+void edf_init_params(tpars *params);
+
+/*
+ * Move the current task under SCHED_DEADLINE, with its period and
+ * deadline and a runtime derived from the WCET of its class. If the
+ * kernel refuses the reservation (admission test) the task keeps its
+ * fixed priority.
+ *
+ * task_class: class of the current task.
+ */
+void edf_task_start(task_class_t task_class);
+
+/*
+ * Change the period (and deadline) of the reservation of the current
+ * task, resizing the runtime on its measured WCET. Nothing is done if
+ * the task does not run under SCHED_DEADLINE.
+ *
+ * period: new period (ms).
+ */
+void edf_set_period(int period);
+
+/*
+ * Add the WCET measured by the current task to its class.
+ */
+void edf_task_end();
+
+/*
+ * Print the reservations of each task class, if enabled.
+ *
+ * out: stream where the report is written.
+ */
+void print_edf_report(FILE *out);
+
+#endif
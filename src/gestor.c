@@ -8,12 +8,34 @@
  * calling the function "access_env" specifying a priority. 
  * After an access, the shared structure is released by calling
  * the function "release_env" with the same priority used to access.
+ * While a task is blocked on the environment, the holder runs with the
+ * scheduling priority of the task if higher (priority inheritance), so
+ * a task of middle priority cannot delay a blocked task of higher one.
  * 
 ********************************************************************/
 
 #include "gestor.h"
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
 #include "ptask.h"
+#include "pmutex.h"
+#include "tstat.h"
+#include "pbarrier.h"
+#include "profiler.h"
+#include "tracer.h"
+#include "perfcnt.h"
+#include "recorder.h"
+#include "shmexport.h"
+#include "rtmem.h"
+#include "edf.h"
+#include "partition.h"
+#include "admission.h"
+#include "opmode.h"
+#include "overrun.h"
+#include "coro.h"
+#include "calib.h"
 #include <allegro.h>
 #include <assert.h>
 #include <math.h>
@@ -28,27 +50,153 @@ typedef enum
     DEF_MISSILE
 }   cell_type_t;
 
-// Type of a single cell in the environment.
+// Type of a single cell in the environment, kept small: the cells are
+// the largest structure of the system.
 typedef struct
 {
-    cell_type_t type;
-    int         value;  // Index of the contained missile or <0 if otherwise. 
-    int         target; // Target index assigned if attacker is discovered.
+    int16_t     value;  // Index of the contained missile or <0 if otherwise. 
+    int16_t     target; // Target index assigned if attacker is discovered.
+    int8_t      type;   // Type of the cell (cell_type_t).
 }   cell_t;
 
+// Cell of the environment at the given coordinates.
+#define CELL(x, y)      (env.cell[(size_t)(x) * ywin + (y)])
+
+// Missile on the screen, element of the list of the active missiles.
+typedef struct
+{
+    missile_type_t  type;   // Type of the missile.
+    int             index;  // Index of the missile.
+    pos_t           pos;    // Cell of the missile.
+    int             target; // Assigned target, or NONE.
+    float           speed;  // Speed of the missile.
+    float           angle;  // Angle of the trajectory.
+}   entity_t;
+
 // Environment of the system. 
 typedef struct
 {
-    cell_t          cell[XWIN][YWIN];       // A cell for each screen pixel.
+    cell_t          *cell;                  // A cell for each screen pixel.
+    size_t          size;                   // Size of the cells.
+    int             locked;                 // Cells locked in memory.
+    entity_t        entity[ENTITIES];       // Active missiles, compact.
+    int             nentities;              // Number of active missiles.
+    int             entity_slot[MISSILE_TYPES][N]; // Slot in the list or NONE.
     int             def_points, atk_points; // Current score.
     int             count;                  // Threads using the structure.
     private_sem_t   prio_sem[ENV_PRIOS];    // Priority queues.
-    sem_t           mutex;                  // Mutex for the structure.
+    pthread_mutex_t mutex;                  // Mutex for the structure (PI).
+    env_caller_t    holder;                 // Caller holding the structure.
+    uint64_t        acq_time;               // Timestamp of the last access.
+    pthread_t       holder_thread;          // Thread holding the structure.
+    int             holder_prio;            // Its priority, NONE if it
+                                            // cannot inherit.
+    int             boost;                  // Its inherited priority.
+    int             waiting[ENV_SCHED_PRIOS]; // Blocked tasks by priority.
 }   env_t;
 
+// Rectangular region of the screen (bounds included).
+typedef struct
+{
+    int x1, y1, x2, y2;
+}   region_t;
+
+// Copy of the active missiles and of the score, taken by the display
+// manager from the environment.
+typedef struct
+{
+    entity_t    entity[ENTITIES];       // Active missiles.
+    int         count;                  // Number of active missiles.
+    int         atk_points, def_points; // Score.
+}   snapshot_t;
+
+// State of the screen at the last frame, used by the display manager to
+// redraw only the regions changed since then.
+typedef struct
+{
+    int         valid;                      // 0 until the first frame.
+    snapshot_t  snap[2];                    // Snapshots of two frames.
+    snapshot_t  *drawn, *next;              // Drawn and to draw.
+    pos_t       pos[MISSILE_TYPES][N];      // Cell of the drawn missiles.
+    unsigned    seen[MISSILE_TYPES][N];     // Last frame with the missile.
+    unsigned    frame;                      // Number of the frame.
+    region_t    dirty[DIRTY_REGIONS];       // Regions to redraw.
+    int         ndirty;                     // Number of regions to redraw.
+    BITMAP      *layer;                     // Static scenery and score.
+    BITMAP      *score_base;                // Scenery under the score.
+    BITMAP      *sprite[MISSILE_TYPES];     // Pre-rendered missiles.
+}   frame_state_t;
+
+// Rate control of the adaptive display manager.
+typedef struct
+{
+    int         enabled;        // Adaptive rate flag.
+    int         period;         // Current period (ms).
+    int         max_period;     // Longest period used (ms).
+    int         calm;           // Time since the last overload (ms).
+    long        misses;         // Missile deadline misses already seen.
+    ptime       exec;           // Execution time already seen (us).
+    long        drawn, skipped; // Frames drawn and skipped.
+}   display_rate_t;
+
+// Horizontal band of the frame, rendered by a single task.
+typedef struct
+{
+    BITMAP      *bmp;       // Sub-bitmap of the buffer.
+    int         y1, y2;     // Rows of the band (bounds included).
+}   tile_t;
+
+// Tile renderer: the frame is split in horizontal tiles, the first one
+// rendered by the display manager and the others by the helper tasks.
+typedef struct
+{
+    int         ntiles;             // Number of tiles.
+    tile_t      tile[MAX_TILES];    // Tiles of the frame.
+    BITMAP      *buffer;            // Buffer split in the tiles.
+    int         helpers;            // Helper tasks running.
+    int         stop;               // Helper tasks must end.
+    pbarrier_t  start;              // Regions to redraw found.
+    pbarrier_t  done;               // Every tile rendered.
+}   renderer_t;
+
 // Global environment used to maintain the status of the system.
 static env_t   env;
 
+// Size of the window (and of the environment).
+int     xwin = DEFAULT_XWIN, ywin = DEFAULT_YWIN;
+
+// State of the screen, used only by the display manager.
+static frame_state_t    last_frame;
+// Region of the score labels.
+static region_t         score_region;
+// Rate control of the display manager.
+static display_rate_t   display_rate;
+// Tile renderer of the display manager (one tile by default).
+static renderer_t       renderer = {1};
+
+// Deadline misses of the missile tasks, read by the display manager.
+static long                 missile_misses;
+// Class of the current task.
+static __thread task_class_t current_class;
+// Priority of the current thread for the inheritance of the environment,
+// read at its first access.
+static __thread int     own_env_prio, own_env_prio_read;
+// 1 if the current thread can inherit a priority (fixed priority).
+static __thread int     own_env_fixed;
+
+// Names of the task classes.
+static char     *task_class_names[TASK_CLASSES] = {
+    "display",
+    "atk_launcher",
+    "atk_missile",
+    "def_launcher",
+    "def_missile",
+    "scenario",
+    "tile",
+    "mode",
+    "wheel"
+};
+
 /********************************************************************
  * INITIALZATIONS
 ********************************************************************/
@@ -75,8 +223,8 @@ static int wall_init_check(int x, int y)
 {
     return x < WALL_THICKNESS ||
            y < WALL_THICKNESS ||
-           XWIN - x < WALL_THICKNESS ||
-           YWIN - y < WALL_THICKNESS;
+           xwin - x < WALL_THICKNESS ||
+           ywin - y < WALL_THICKNESS;
 }
 
 /*
@@ -122,15 +270,15 @@ static void init_cell(int x, int y)
 {
     if (wall_init_check(x, y))
     {
-        init_wall_cell(&(env.cell[x][y]));
+        init_wall_cell(&(CELL(x, y)));
     }
     else if (goal_init_check(y))
     {
-        init_goal_cell(&(env.cell[x][y]));
+        init_goal_cell(&(CELL(x, y)));
     }
     else
     {
-        init_cell_empty(&(env.cell[x][y]));
+        init_cell_empty(&(CELL(x, y)));
     }
 }
 
@@ -141,24 +289,111 @@ static void init_cell(int x, int y)
 static void display_init()
 {
     allegro_init();
-    set_gfx_mode(GFX_AUTODETECT_WINDOWED, XWIN, YWIN, 0, 0);
+    set_gfx_mode(GFX_AUTODETECT_WINDOWED, xwin, ywin, 0, 0);
     clear_to_color(screen, BKG_COLOR);
     install_keyboard();
 }
 
 /*
- * Initialize environment: cells, scores and semaphores.
+ * Initialize the state of the screen: the first frame is fully drawn.
+ * The static layer, if already composed, is kept: the scenery does not
+ * change and the score is drawn again with the first frame.
+ */
+static void init_frame_state()
+{
+    int t, i;
+
+    last_frame.valid = 0;
+    last_frame.ndirty = 0;
+    last_frame.drawn = &(last_frame.snap[0]);
+    last_frame.next = &(last_frame.snap[1]);
+    last_frame.drawn->count = 0;
+
+    for (t = 0; t < MISSILE_TYPES; t++)
+    {
+        for (i = 0; i < N; i++)
+        {
+            last_frame.pos[t][i].x = last_frame.pos[t][i].y = NONE;
+        }
+    }
+
+    /* Score, on the bottom left corner. */
+    score_region.x1 = LABEL_X;
+    score_region.y1 = GET_Y_LABEL(2);
+    score_region.x2 = LABEL_X + SCORE_W;
+    score_region.y2 = GET_Y_LABEL(1) + LABEL_H - 1;
+}
+
+/*
+ * Allocate the cells of the environment, xwin * ywin. If locked, the
+ * cells are allocated on huge pages, when available, and locked in
+ * memory, so the tasks never fault on them; else transparent huge
+ * pages are only suggested to the kernel.
+ */
+static void alloc_env_cells()
+{
+    void    *map;
+
+    env.size = (size_t)xwin * ywin * sizeof(cell_t);
+    map = MAP_FAILED;
+
+    if (env.locked)
+    {
+        env.size = (env.size + ENV_HUGEPAGE_SIZE - 1) /
+                   ENV_HUGEPAGE_SIZE * ENV_HUGEPAGE_SIZE;
+        map = mmap(NULL, env.size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                   -1, 0);
+        if (map == MAP_FAILED)
+        {
+            fprintf(stderr, "GESTOR: No huge pages, using normal pages\n");
+        }
+    }
+
+    if (map == MAP_FAILED)
+    {
+        map = mmap(NULL, env.size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(map != MAP_FAILED);
+        madvise(map, env.size, MADV_HUGEPAGE);
+    }
+
+    if (env.locked && mlock(map, env.size) != 0)
+    {
+        perror("GESTOR: Unable to lock the environment in memory");
+    }
+
+    env.cell = map;
+}
+
+/*
+ * Initialize environment: cells, missiles, scores, semaphores and the
+ * state of the screen. The cells are allocated at the first call.
  */
 static void init_env()
 {
-    int x, y, i;
+    int x, y, i, t;
+
+    if (env.cell == NULL)
+    {
+        alloc_env_cells();
+    }
 
     env.atk_points = env.def_points = 0;
+    env.nentities = 0;
+
+    for (t = 0; t < MISSILE_TYPES; t++)
+    {
+        for (i = 0; i < N; i++)
+        {
+            env.entity_slot[t][i] = NONE;
+        }
+    }
 
     /* Initialize every cell of the environment. */
-    for (x = 0; x < XWIN; x++)
+    for (x = 0; x < xwin; x++)
     {
-        for (y = 0; y < YWIN; y++)
+        for (y = 0; y < ywin; y++)
         {
             init_cell(x, y);
         }
@@ -171,8 +406,12 @@ static void init_env()
     }
 
     env.count = 0;
+    env.holder_prio = env.boost = NONE;
+    memset(env.waiting, 0, sizeof(env.waiting));
+
+    pmux_create_pi(&env.mutex);
 
-    sem_init(&env.mutex, 0, 1);
+    init_frame_state();
 }
 
 /*
@@ -196,10 +435,108 @@ void check_deadline(char *message)
 {
     if (ptask_deadline_miss())
     {
+        if (current_class == ATK_MISSILE_TASK ||
+            current_class == DEF_MISSILE_TASK ||
+            current_class == WHEEL_TASK)
+        {
+            __atomic_fetch_add(&missile_misses, 1, __ATOMIC_RELAXED);
+        }
+
+        mode_deadline_miss();
+        trace_deadline_miss();
+        record(REC_DEADLINE_MISS, 0, 0, 0, 0, ptask_get_index());
+        shm_deadline_miss();
         fputs(message, stderr);
     }
 }
 
+/*
+ * Get the name of a task class.
+ */
+char *task_class_name(task_class_t task_class)
+{
+    return task_class_names[task_class];
+}
+
+/*
+ * Start the body of the current task: prefault its stack, move it to
+ * its scheduling (EDF, partition), add it to the admitted set and
+ * signal it to the performance counters, the tracer, the shared memory
+ * export, the calibration and the overrun handling. Nothing is done in
+ * a coroutine.
+ */
+void task_start(task_class_t task_class)
+{
+    /* A coroutine runs in the job of its dispatcher. */
+    if (in_coro())
+    {
+        return;
+    }
+
+    current_class = task_class;
+
+    rt_task_start();
+    edf_task_start(task_class);
+    partition_task_start(task_class);
+    admission_task_start(task_class);
+
+    perfcnt_task_start(task_class);
+    trace_task_start(task_class_name(task_class));
+    shm_task_start(task_class_name(task_class));
+    calib_task_start(task_class);
+    overrun_task_start(task_class);
+}
+
+/*
+ * End the body of the current task, undoing task_start in reverse
+ * order. Nothing is done in a coroutine.
+ */
+void task_end()
+{
+    if (in_coro())
+    {
+        return;
+    }
+
+    overrun_task_end();
+    calib_task_end();
+    edf_task_end();
+    partition_task_end();
+    admission_task_end();
+    shm_task_end();
+    trace_task_end();
+    perfcnt_task_end();
+}
+
+/*
+ * Wait for the next period of the current task, signaling the end of
+ * the current job (overrun handling, performance counters, modes,
+ * calibration, shared memory export, tracer) and the activation of the
+ * next one, suspended while the task is out of the current mode. A
+ * coroutine yields to its dispatcher instead.
+ */
+void task_wait_for_period()
+{
+    /* A coroutine waits for its next resume by the dispatcher. */
+    if (in_coro())
+    {
+        coro_yield();
+        return;
+    }
+
+    overrun_job_end();
+    perfcnt_sample();
+    mode_job_end();
+    calib_job_end();
+    shm_job_end();
+    trace_job_end();
+    ptask_wait_for_period();
+    mode_job_start();
+    trace_job_start();
+    shm_job_start();
+    overrun_job_start();
+}
+
 /*
  * Check if a deadline was missed by a messile task and print an informative
  * formatted string.
@@ -217,16 +554,6 @@ void check_missile_deadline(char *message, missile_type_t type, int index)
     check_deadline(s);
 }
 
-/*
- * Reset the buffer to the background color.
- * 
- * buffer: reference to the buffer.
- */
-static void reset_buffer(BITMAP *buffer)
-{
-    clear_to_color(buffer, BKG_COLOR);
-}
-
 /*
  * Convert missile type in the corresponding cell type.
  * 
@@ -239,13 +566,46 @@ static cell_type_t missile_to_cell_type(missile_type_t m_type)
 }
 
 /*
- * Convert cell type in the corresponding missile type. 
+ * Set the cell of a missile in the list of the active missiles. A
+ * missile that left the environment is replaced by the last one of the
+ * list, so the list stays compact.
  * 
- * cell_type: type of the cell.
- * ~return: type of missile relative to the cell type.
+ * type: type of the missile.
+ * index: index of the missile.
+ * x: x coordinate of the cell, NONE if the missile left the environment.
+ * y: y coordinate of the cell, NONE if the missile left the environment.
  */
-static missile_type_t cell_to_missile_type(cell_type_t cell_type) {
-    return cell_type == ATK_MISSILE ? ATTACKER : DEFENDER;
+static void set_missile_pos(missile_type_t type, int index, int x, int y)
+{
+    entity_t    *last;
+    int         slot;
+
+    slot = env.entity_slot[type][index];
+
+    if (x == NONE)
+    {
+        if (slot != NONE)
+        {
+            last = &(env.entity[--env.nentities]);
+            env.entity[slot] = *last;
+            env.entity_slot[last->type][last->index] = slot;
+            env.entity_slot[type][index] = NONE;
+        }
+        return;
+    }
+
+    if (slot == NONE)
+    {
+        slot = env.nentities++;
+        env.entity_slot[type][index] = slot;
+        env.entity[slot].type = type;
+        env.entity[slot].index = index;
+        env.entity[slot].target = NONE;
+        env.entity[slot].speed = env.entity[slot].angle = 0;
+    }
+
+    env.entity[slot].pos.x = x;
+    env.entity[slot].pos.y = y;
 }
 
 /*
@@ -257,8 +617,8 @@ static missile_type_t cell_to_missile_type(cell_type_t cell_type) {
  */
 int check_borders(int x, int y)
 {
-    return x < XWIN &&
-           y < YWIN &&
+    return x < xwin &&
+           y < ywin &&
            x >= 0 &&
            y >= 0;
 }
@@ -279,18 +639,6 @@ static int is_empty_cell(cell_t *cell)
            (cell->value == EMPTY_CELL);
 }
 
-/*
- * Check if the cell containes missile data.
- * 
- * cell: reference to the cell.
- * ~return: 1 if the cell is a missile, else 0.
- */
-static int is_missile_cell(cell_t *cell)
-{
-    return !is_empty_cell(cell) &&
-           (cell->type == ATK_MISSILE || cell->type == DEF_MISSILE);
-}
-
 /*
  * Check if the cell is a wall cell.
  * 
@@ -321,17 +669,108 @@ static int is_goal_cell(cell_t *cell)
  * ENVIRONMENT ACCESS
 ********************************************************************/
 
+/*
+ * Get the scheduling priority of the current thread, read at its first
+ * access to the environment: the tasks do not change policy after
+ * their start.
+ * 
+ * ~return: fixed priority, ENV_DEADLINE_PRIO under SCHED_DEADLINE, NONE
+ * for the other policies (the main thread).
+ */
+static int env_sched_prio()
+{
+    struct sched_param  param;
+    int                 policy;
+
+    if (own_env_prio_read)
+    {
+        return own_env_prio;
+    }
+
+    /* From the kernel: the library does not know SCHED_DEADLINE. */
+    policy = sched_getscheduler(0);
+    sched_getparam(0, &param);
+
+    own_env_fixed = policy == SCHED_FIFO || policy == SCHED_RR;
+    own_env_prio = own_env_fixed ? param.sched_priority :
+                   policy == SCHED_DEADLINE ? ENV_DEADLINE_PRIO : NONE;
+    own_env_prio_read = 1;
+
+    return own_env_prio;
+}
+
+/*
+ * Register the current task as blocked on the environment and raise
+ * the holder to its priority, if higher. Called with env.mutex locked.
+ * 
+ * own: priority of the current task.
+ */
+static void inherit_env_prio(int own)
+{
+    if (own == NONE)
+    {
+        return;
+    }
+
+    env.waiting[own]++;
+
+    if (env.holder_prio != NONE && own > env.boost)
+    {
+        env.boost = own;
+        pthread_setschedprio(env.holder_thread, own);
+    }
+}
+
+/*
+ * Register the current task as the holder of the environment, raising
+ * it to the priority of the tasks already blocked, if higher. Called
+ * with env.mutex locked.
+ * 
+ * own: priority of the current task.
+ */
+static void hold_env(int own)
+{
+    int p;
+
+    env.holder_thread = pthread_self();
+    env.holder_prio = env.boost = own_env_fixed ? own : NONE;
+
+    if (env.holder_prio == NONE)
+    {
+        return;
+    }
+
+    for (p = ENV_SCHED_PRIOS - 1; p > own && !env.waiting[p]; p--)
+    {
+        /* Highest priority of a blocked task. */
+    }
+
+    if (p > own)
+    {
+        env.boost = p;
+        pthread_setschedprio(env.holder_thread, p);
+    }
+}
+
 /*
  * BLOCKING: Controls access to the environment structure.
  * 
  * prio: priority to request the access.
+ * caller: caller requesting the access, used by the profiler.
  */
-static void access_env(int prio)
+static void access_env(int prio, env_caller_t caller)
 {
-    int lock, p;
+    int         lock, p, depth, own;
+    uint64_t    t_req;
+
+    t_req = prof_now();
+    trace_begin("access_env");
+
+    own = env_sched_prio();
 
-    sem_wait(&env.mutex);
+    pthread_mutex_lock(&env.mutex);
     lock = 0;
+    depth = env.count;
 
     /* Check for blocked lower prio tasks. */
     for (p = prio; p >= 0; p--)
@@ -339,16 +778,39 @@ static void access_env(int prio)
         lock |= env.prio_sem[p].blk;
     }
 
+    for (p = 0; p < ENV_PRIOS; p++)
+    {
+        depth += env.prio_sem[p].blk;
+    }
+
     if (env.count || lock)
     {
         env.prio_sem[prio].blk++;
-        sem_post(&env.mutex);
+        inherit_env_prio(own);
+        pthread_mutex_unlock(&env.mutex);
+
+        /* Handed over by release_env, count included. */
         sem_wait(&(env.prio_sem[prio].sem));
-        env.prio_sem[prio].blk--;
+
+        pthread_mutex_lock(&env.mutex);
+        if (own != NONE)
+        {
+            env.waiting[own]--;
+        }
     }
-    env.count++;
+    else
+    {
+        env.count++;
+    }
+
+    hold_env(own);
+    env.holder = caller;
+    env.acq_time = prof_env_acquired(prio, caller, t_req, depth);
+
+    trace_end("access_env");
+    trace_begin(env_caller_name(caller));
 
-    sem_post(&env.mutex);
+    pthread_mutex_unlock(&env.mutex);
 }
 
 /*
@@ -358,11 +820,18 @@ static void access_env(int prio)
  */
 static void release_env(int prio)
 {
-    int next_prio, stop;
+    int next_prio, stop, own, boost;
 
-    sem_wait(&env.mutex);
+    pthread_mutex_lock(&env.mutex);
+
+    prof_env_released(prio, env.holder, env.acq_time);
+    trace_end(env_caller_name(env.holder));
+
+    /* No holder to raise until the woken task registers itself. */
+    own = env.holder_prio;
+    boost = env.boost;
+    env.holder_prio = env.boost = NONE;
 
-    env.count--;
     stop = 0;
 
     /* Wake a blocked task starting by the next one with lower prio. */
@@ -372,13 +841,23 @@ static void release_env(int prio)
         next_prio = (next_prio + 1) % ENV_PRIOS;
         if (env.prio_sem[next_prio].blk)
         {
+            env.prio_sem[next_prio].blk--;
             sem_post(&(env.prio_sem[next_prio].sem));
-            stop = 1;   // Wakes only one task.
+            stop = 1;   // Wakes only one task, which keeps the count.
         }
     } while (!stop && next_prio != prio);
 
-    if (!stop) {        // If no task was waken, just release mutex.
-        sem_post(&env.mutex);
+    if (!stop)          // If no task was waken, the structure is free.
+    {
+        env.count--;
+    }
+
+    pthread_mutex_unlock(&env.mutex);
+
+    /* Back to the own priority after the hand over. */
+    if (boost != own)
+    {
+        pthread_setschedprio(pthread_self(), own);
     }
 }
 
@@ -392,6 +871,7 @@ static void release_env(int prio)
 static void def_point()
 {
     env.def_points++;
+    record(REC_SCORE, 0, 0, env.atk_points, env.def_points, 0);
 }
 
 /*
@@ -400,6 +880,7 @@ static void def_point()
 static void atk_point()
 {
     env.atk_points++;
+    record(REC_SCORE, 0, 0, env.atk_points, env.def_points, 0);
 }
 
 /*
@@ -417,10 +898,12 @@ static cell_type_t handle_collision_by_cell_type(cell_t *cell)
     {
     case DEF_MISSILE:   // Collision with defender missile.
         delete_def_missile(cell->value);
+        set_missile_pos(DEFENDER, cell->value, NONE, NONE);
         init_cell_empty(cell);
         break;
     case ATK_MISSILE:   // Collision with attacker missile.
         delete_atk_missile(cell->value);
+        set_missile_pos(ATTACKER, cell->value, NONE, NONE);
         init_cell_empty(cell);
         break;
     default:
@@ -490,12 +973,16 @@ static int collision_around(int xa, int ya, int xb, int yb, missile_t *missile)
         for (y = ya; !ret && y < yb; y++)
         {
             /* Check cell value and cell type to avoid self collisions. */
-            if ((env.cell[x][y].value != missile->index ||
-                 env.cell[x][y].type != cell_type) &&
-                !is_empty_cell(&(env.cell[x][y])) &&
-                handle_collision(missile_type, &(env.cell[x][y])))
+            if ((CELL(x, y).value != missile->index ||
+                 CELL(x, y).type != cell_type) &&
+                !is_empty_cell(&(CELL(x, y))))
             {
-                ret = 1;    // Stop after first collision found.
+                /* Recorded before the handling clears the cell. */
+                record(REC_COLLISION, missile_type, missile->index, x, y,
+                       CELL(x, y).type);
+
+                /* Stop after first collision found. */
+                ret = handle_collision(missile_type, &(CELL(x, y)));
             }
         }
     }
@@ -522,8 +1009,8 @@ static int handle_collisions_around_missile(missile_t *missile, int span)
         /* Get start and ending point around missile. */
         xa = missile->x - span >= 0 ? missile->x - span : 0;
         ya = missile->y - span >= 0 ? missile->y - span : 0;
-        xb = missile->x + span < XWIN ? missile->x + span : XWIN;
-        yb = missile->y + span < YWIN ? missile->y + span : YWIN;
+        xb = missile->x + span < xwin ? missile->x + span : xwin;
+        yb = missile->y + span < ywin ? missile->y + span : ywin;
 
         ret = collision_around(xa, ya, xb, yb, missile);
     }
@@ -538,6 +1025,7 @@ static int handle_collisions_around_missile(missile_t *missile, int span)
  */
 static void update_missile_cell(missile_t *missile)
 {
+    entity_t    *e;
     int         x, y;
     cell_type_t type;
 
@@ -545,9 +1033,17 @@ static void update_missile_cell(missile_t *missile)
     y = missile->y;
     type = missile_to_cell_type(missile->missile_type);
 
-    env.cell[x][y].value = missile->index;
-    env.cell[x][y].type = type;
-    env.cell[x][y].target = missile->assigned_target;
+    CELL(x, y).value = missile->index;
+    CELL(x, y).type = type;
+    CELL(x, y).target = missile->assigned_target;
+
+    set_missile_pos(missile->missile_type, missile->index, x, y);
+
+    /* The state published by the export, as the environment holds it. */
+    e = &(env.entity[env.entity_slot[missile->missile_type][missile->index]]);
+    e->target = missile->assigned_target;
+    e->speed = missile->speed;
+    e->angle = missile->angle;
 }
 
 /*
@@ -562,13 +1058,16 @@ static int update_missile_position(missile_t *missile, int oldx, int oldy)
 {
     int collided;
 
-    init_cell_empty(&(env.cell[oldx][oldy]));
+    init_cell_empty(&(CELL(oldx, oldy)));
+    set_missile_pos(missile->missile_type, missile->index, NONE, NONE);
 
     collided = handle_collisions_around_missile(missile, MISSILE_RADIUS);
 
     if (!collided)
     {
         update_missile_cell(missile);
+        record(REC_POSITION, missile->missile_type, missile->index,
+               missile->x, missile->y, missile->assigned_target);
     }
 
     return collided;
@@ -586,7 +1085,7 @@ int update_missile_env(missile_t *missile, int oldx, int oldy)
 {
     int collided;
 
-    access_env(MIDDLE_ENV_PRIO);
+    access_env(MIDDLE_ENV_PRIO, ENV_CALLER_MISSILE);
 
     /* Avoid to update missile position if was deleted. */
     if (missile->deleted)
@@ -604,7 +1103,9 @@ int update_missile_env(missile_t *missile, int oldx, int oldy)
 }
 
 /*
- * Search screen for the <target>'s current position.
+ * Search the environment for the <target>'s current position. Only the
+ * cells of the active attacker missiles can hold a target, so only
+ * those are checked, whatever the size of the environment.
  * 
  * target: index of the target to search in the screen.
  * ~return: current position of the target. If the target
@@ -612,24 +1113,23 @@ int update_missile_env(missile_t *missile, int oldx, int oldy)
  */
 pos_t scan_env_for_target_pos(int target)
 {
-    pos_t   current_pos, ret_pos;
-    int     ret;
+    entity_t    *e;
+    pos_t       ret_pos;
+    int         i, ret;
 
     ret_pos.x = NONE;
     ret_pos.y = NONE;
     ret = 0;
 
-    access_env(LOW_ENV_PRIO);
+    access_env(LOW_ENV_PRIO, ENV_CALLER_TARGET_POS);
 
-    for (current_pos.x = 0; !ret && current_pos.x < XWIN; current_pos.x++)
+    for (i = 0; !ret && i < env.nentities; i++)
     {
-        for (current_pos.y = 0; !ret && current_pos.y < YWIN; current_pos.y++)
+        e = &(env.entity[i]);
+        if (e->type == ATTACKER && CELL(e->pos.x, e->pos.y).target == target)
         {
-            if (env.cell[current_pos.x][current_pos.y].target == target)
-            {
-                ret_pos = current_pos;
-                ret = 1;    // Stop checking if target is found.
-            }
+            ret_pos = e->pos;
+            ret = 1;    // Stop checking if target is found.
         }
     }
 
@@ -647,7 +1147,7 @@ pos_t scan_env_for_target_pos(int target)
  */
 static int check_pixel(int x, int y)
 {
-    cell_t  cell = env.cell[x][y];
+    cell_t  cell = CELL(x, y);
     int     ret;
 
     ret = 0;
@@ -663,36 +1163,47 @@ static int check_pixel(int x, int y)
 
 /*
  * Search screen for a new target (attacker missile) and marks
- * it as tracked by assigning ad index <t_assign>.
+ * it as tracked by assigning ad index <t_assign>. Only the pixels at
+ * the position of the active attacker missiles are checked; the
+ * topmost one is chosen, as scanning the screen by rows.
  * 
  * t_assign: index to assign to the eventual found target.
  * ~return: 1 if a target was found, else 0.
  */
 int search_screen_for_target(int t_assign)
 {
-    int x, y, ret;
+    entity_t    *e, *found;
+    int         i, x, y;
 
-    ret = 0;
+    found = NULL;
 
-    access_env(LOW_ENV_PRIO);
+    access_env(LOW_ENV_PRIO, ENV_CALLER_TARGET_SEARCH);
 
-    for (y = 0; !ret && y < YWIN; y++)
+    for (i = 0; i < env.nentities; i++)
     {
-        for (x = 0; !ret && x < XWIN; x++)
+        e = &(env.entity[i]);
+        if (e->type == ATTACKER && check_pixel(e->pos.x, e->pos.y) &&
+            (found == NULL || e->pos.y < found->pos.y ||
+             (e->pos.y == found->pos.y && e->pos.x < found->pos.x)))
         {
-            if (check_pixel(x, y))
-            {
-                /* Assign target index to an untracked attacker missile. */
-                assign_target_to_atk(env.cell[x][y].value, t_assign);
-                env.cell[x][y].target = t_assign;
-                ret = 1;    // Stop at the first target found.
-            }
+            found = e;
         }
     }
 
+    if (found != NULL)
+    {
+        x = found->pos.x;
+        y = found->pos.y;
+
+        /* Assign target index to an untracked attacker missile. */
+        assign_target_to_atk(CELL(x, y).value, t_assign);
+        CELL(x, y).target = t_assign;
+        record(REC_ASSIGN, ATTACKER, CELL(x, y).value, x, y, t_assign);
+    }
+
     release_env(LOW_ENV_PRIO);
 
-    return ret;
+    return found != NULL;
 }
 
 /********************************************************************
@@ -737,17 +1248,29 @@ static void draw_legends(BITMAP *buffer)
 }
 
 /*
- * Draw the legend on the buffer.
+ * Draw the constant labels on the buffer: tutorial and legend.
  * 
  * buffer: reference to the buffer to write.
  */
-static void draw_labels(BITMAP *buffer, int atk_p, int def_p)
+static void draw_labels(BITMAP *buffer)
 {
-    char    s[LABEL_LEN];
-
     textout_centre_ex(buffer, font, 
                       "Press SPACE to create an attacker missile, ESC to exit", 
-                      XWIN / 2, TUTORIAL_Y, LABEL_COLOR, BKG_COLOR);
+                      xwin / 2, TUTORIAL_Y, LABEL_COLOR, BKG_COLOR);
+
+    draw_legends(buffer);
+}
+
+/*
+ * Draw the score labels on the buffer.
+ * 
+ * buffer: reference to the buffer to write.
+ * atk_p: attacker points.
+ * def_p: defender points.
+ */
+static void draw_score(BITMAP *buffer, int atk_p, int def_p)
+{
+    char    s[LABEL_LEN];
 
     sprintf(s, "Attack points: %i", atk_p);
     textout_ex(buffer, font, s, LABEL_X,
@@ -756,34 +1279,22 @@ static void draw_labels(BITMAP *buffer, int atk_p, int def_p)
     sprintf(s, "Defender points: %i", def_p);
     textout_ex(buffer, font, s, LABEL_X,
                GET_Y_LABEL(2), LABEL_COLOR, BKG_COLOR);
-
-    draw_legends(buffer);
 }
 
 /*
- * Draw a missile on the buffer.
+ * Draw a missile on a tile, using its pre-rendered sprite.
  * 
- * buffer: reference to the buffer to write.
+ * tile: reference to the tile to write.
  * pos: position of the missile to draw.
  * type: type of the missile to draw.
  */
-static void draw_missile(BITMAP *buffer, pos_t pos, missile_type_t type)
+static void draw_missile(tile_t *tile, pos_t pos, missile_type_t type)
 {
-    int color;
-
     /* Don't need to draw missile outside borders. */
     if (check_borders(pos.x, pos.y))
     {
-        if (type == ATTACKER)
-        {
-            color = ATTACKER_COLOR;
-        }
-        else
-        {
-            color = DEFENDER_COLOR;
-        }
-
-        circlefill(buffer, pos.x, pos.y, MISSILE_RADIUS, color);
+        draw_sprite(tile->bmp, last_frame.sprite[type],
+                    pos.x - MISSILE_RADIUS, pos.y - MISSILE_RADIUS - tile->y1);
     }
 }
 
@@ -809,99 +1320,634 @@ static void draw_goal(pos_t pos, BITMAP *buffer)
     putpixel(buffer, pos.x, pos.y, GOAL_COLOR);
 }
 
+/********************************************************************
+ * DIRTY REGIONS DRAW
+********************************************************************/
+
 /*
- * Draw a single cell in the buffer.
+ * Get the region of the screen covered by a missile.
  * 
- * buffer: reference to the buffer to write.
- * x: x coordinate of the cell.
- * y: y coordinate of the cell.
- * cell: reference to the cell to draw.
+ * pos: position of the missile.
+ * ~return: region of the missile, limited to the screen.
  */
-static void draw_cell(cell_t *cell, int x, int y, BITMAP *buffer)
+static region_t missile_region(pos_t pos)
 {
-    missile_type_t  m_type;
-    pos_t           pos;
+    region_t    r;
+
+    r.x1 = pos.x - MISSILE_RADIUS > 0 ? pos.x - MISSILE_RADIUS : 0;
+    r.y1 = pos.y - MISSILE_RADIUS > 0 ? pos.y - MISSILE_RADIUS : 0;
+    r.x2 = pos.x + MISSILE_RADIUS < xwin ? pos.x + MISSILE_RADIUS : xwin - 1;
+    r.y2 = pos.y + MISSILE_RADIUS < ywin ? pos.y + MISSILE_RADIUS : ywin - 1;
 
-    pos.x = x;
-    pos.y = y;
+    return r;
+}
+
+/*
+ * Check if two regions overlap.
+ * 
+ * a: reference to the first region.
+ * b: reference to the second region.
+ * ~return: 1 if the regions overlap, else 0.
+ */
+static int regions_overlap(region_t *a, region_t *b)
+{
+    return a->x1 <= b->x2 && b->x1 <= a->x2 &&
+           a->y1 <= b->y2 && b->y1 <= a->y2;
+}
 
-    if (is_missile_cell(cell))
+/*
+ * Add a region to redraw. A region overlapping the last added one (the
+ * old and new position of a missile that moved a little) is merged
+ * with it.
+ * 
+ * r: region to redraw.
+ */
+static void add_dirty_region(region_t r)
+{
+    region_t    *last;
+
+    if (last_frame.ndirty > 0)
     {
-        m_type = cell_to_missile_type(cell->type);
-        draw_missile(buffer, pos, m_type);
+        last = &(last_frame.dirty[last_frame.ndirty - 1]);
+        if (regions_overlap(last, &r))
+        {
+            last->x1 = r.x1 < last->x1 ? r.x1 : last->x1;
+            last->y1 = r.y1 < last->y1 ? r.y1 : last->y1;
+            last->x2 = r.x2 > last->x2 ? r.x2 : last->x2;
+            last->y2 = r.y2 > last->y2 ? r.y2 : last->y2;
+            return;
+        }
     }
-    else if (is_wall_cell(cell))
+
+    assert(last_frame.ndirty < DIRTY_REGIONS);
+    last_frame.dirty[last_frame.ndirty++] = r;
+}
+
+/*
+ * Draw the wall and goal cells inside a region.
+ * 
+ * buffer: reference to the buffer to write.
+ * r: reference to the region.
+ */
+static void draw_static_region(BITMAP *buffer, region_t *r)
+{
+    pos_t   pos;
+
+    for (pos.x = r->x1; pos.x <= r->x2; pos.x++)
     {
-        draw_wall(pos, buffer);
+        for (pos.y = r->y1; pos.y <= r->y2; pos.y++)
+        {
+            if (is_wall_cell(&(CELL(pos.x, pos.y))))
+            {
+                draw_wall(pos, buffer);
+            }
+            else if (is_goal_cell(&(CELL(pos.x, pos.y))))
+            {
+                draw_goal(pos, buffer);
+            }
+        }
     }
-    else if (is_goal_cell(cell))
+}
+
+/*
+ * Compose the static layer, base of every frame: background, wall and
+ * goal cells, tutorial and legend. The cells are scanned only here,
+ * once. Must be called with access to the environment.
+ */
+static void compose_static_layer()
+{
+    region_t    all, *r;
+
+    all.x1 = all.y1 = 0;
+    all.x2 = xwin - 1;
+    all.y2 = ywin - 1;
+
+    last_frame.layer = create_bitmap(xwin, ywin);
+    clear_to_color(last_frame.layer, BKG_COLOR);
+
+    draw_static_region(last_frame.layer, &all);
+    draw_labels(last_frame.layer);
+
+    /* Scenery under the score, restored when the score changes. */
+    r = &score_region;
+    last_frame.score_base = create_bitmap(r->x2 - r->x1 + 1,
+                                          r->y2 - r->y1 + 1);
+    blit(last_frame.layer, last_frame.score_base, r->x1, r->y1, 0, 0,
+         r->x2 - r->x1 + 1, r->y2 - r->y1 + 1);
+}
+
+/*
+ * Pre-render the sprite of every type of missile.
+ */
+static void create_missile_sprites()
+{
+    BITMAP  *sprite;
+    int     t, size;
+
+    size = 2 * MISSILE_RADIUS + 1;
+
+    for (t = 0; t < MISSILE_TYPES; t++)
     {
-        draw_goal(pos, buffer);
+        sprite = create_bitmap(size, size);
+        clear_to_color(sprite, bitmap_mask_color(sprite));
+        circlefill(sprite, MISSILE_RADIUS, MISSILE_RADIUS, MISSILE_RADIUS,
+                   t == ATTACKER ? ATTACKER_COLOR : DEFENDER_COLOR);
+
+        last_frame.sprite[t] = sprite;
     }
 }
 
 /*
- * Draw the current environment state in the buffer.
+ * Draw the score on the static layer, over the scenery of its region.
  * 
- * buffer: reference to the buffer to write.
+ * atk_p: attacker points.
+ * def_p: defender points.
+ */
+static void update_layer_score(int atk_p, int def_p)
+{
+    region_t    *r;
+
+    r = &score_region;
+
+    blit(last_frame.score_base, last_frame.layer, 0, 0, r->x1, r->y1,
+         r->x2 - r->x1 + 1, r->y2 - r->y1 + 1);
+    draw_score(last_frame.layer, atk_p, def_p);
+}
+
+/*
+ * Copy the active missiles and the score in the next snapshot. Must be
+ * called with access to the environment.
  */
-static void draw_env(BITMAP *buffer)
+static void take_snapshot()
 {
-    int x, y;
+    snapshot_t  *s;
 
-    access_env(HIGH_ENV_PRIO);
+    s = last_frame.next;
 
-    for (x = 0; x < XWIN; x++)
+    s->count = env.nentities;
+    memcpy(s->entity, env.entity, env.nentities * sizeof(entity_t));
+    s->atk_points = env.atk_points;
+    s->def_points = env.def_points;
+}
+
+/*
+ * Publish a snapshot in the shared memory: the missiles as the
+ * environment held them when it was taken.
+ *
+ * s: reference to the snapshot.
+ */
+static void publish_snapshot(snapshot_t *s)
+{
+    entity_t    *e;
+    int         i;
+
+    shm_world_begin(s->atk_points, s->def_points);
+
+    for (i = 0; i < s->count; i++)
     {
-        for (y = 0; y < YWIN; y++)
+        e = &(s->entity[i]);
+        shm_world_missile(e->type, e->index, e->pos.x, e->pos.y, e->target,
+                          e->speed, e->angle);
+    }
+
+    shm_world_end();
+}
+
+/*
+ * Find the regions changed between the drawn and the next snapshot: old
+ * and new position of the missiles that moved, appeared or left, and
+ * the score, if changed. Only the missiles in the snapshots are checked.
+ * The score on the static layer is updated only when changed. The first
+ * frame is fully redrawn.
+ */
+static void find_dirty_regions()
+{
+    region_t    all;
+    entity_t    *e;
+    pos_t       *old;
+    int         i;
+
+    last_frame.ndirty = 0;
+    last_frame.frame++;
+
+    if (!last_frame.valid)
+    {
+        all.x1 = all.y1 = 0;
+        all.x2 = xwin - 1;
+        all.y2 = ywin - 1;
+        add_dirty_region(all);
+    }
+
+    /* Missiles in the next snapshot: moved or appeared. */
+    for (i = 0; i < last_frame.next->count; i++)
+    {
+        e = &(last_frame.next->entity[i]);
+        old = &(last_frame.pos[e->type][e->index]);
+
+        if (last_frame.valid && (old->x != e->pos.x || old->y != e->pos.y))
         {
-            if (!is_empty_cell(&(env.cell[x][y])))
+            if (old->x != NONE)
             {
-                draw_cell(&(env.cell[x][y]), x, y, buffer);
+                add_dirty_region(missile_region(*old));
             }
+            add_dirty_region(missile_region(e->pos));
         }
+
+        *old = e->pos;
+        last_frame.seen[e->type][e->index] = last_frame.frame;
     }
 
-    draw_labels(buffer, env.atk_points, env.def_points);
+    /* Missiles drawn and not in the next snapshot: left. */
+    for (i = 0; i < last_frame.drawn->count; i++)
+    {
+        e = &(last_frame.drawn->entity[i]);
+        old = &(last_frame.pos[e->type][e->index]);
 
-    release_env(HIGH_ENV_PRIO);
+        if (last_frame.seen[e->type][e->index] != last_frame.frame)
+        {
+            if (last_frame.valid)
+            {
+                add_dirty_region(missile_region(*old));
+            }
+            old->x = old->y = NONE;
+        }
+    }
+
+    if (!last_frame.valid ||
+        last_frame.drawn->atk_points != last_frame.next->atk_points ||
+        last_frame.drawn->def_points != last_frame.next->def_points)
+    {
+        update_layer_score(last_frame.next->atk_points,
+                           last_frame.next->def_points);
+        if (last_frame.valid)
+        {
+            add_dirty_region(score_region);
+        }
+    }
+
+    last_frame.valid = 1;
+}
+
+/*
+ * Redraw a region of a tile: the static layer under it and the missiles
+ * of the next snapshot overlapping it.
+ * 
+ * tile: reference to the tile to write.
+ * r: reference to the region, inside the tile.
+ */
+static void draw_region(tile_t *tile, region_t *r)
+{
+    region_t    m;
+    entity_t    *e;
+    int         i;
+
+    blit(last_frame.layer, tile->bmp, r->x1, r->y1, r->x1, r->y1 - tile->y1,
+         r->x2 - r->x1 + 1, r->y2 - r->y1 + 1);
+
+    set_clip_rect(tile->bmp, r->x1, r->y1 - tile->y1, r->x2, r->y2 - tile->y1);
+
+    for (i = 0; i < last_frame.next->count; i++)
+    {
+        e = &(last_frame.next->entity[i]);
+
+        m = missile_region(e->pos);
+        if (regions_overlap(&m, r))
+        {
+            draw_missile(tile, e->pos, e->type);
+        }
+    }
+
+    set_clip_rect(tile->bmp, 0, 0, xwin - 1, tile->y2 - tile->y1);
+}
+
+/*
+ * Redraw the part of the regions to redraw inside a tile.
+ * 
+ * tile: reference to the tile to write.
+ */
+static void render_tile(tile_t *tile)
+{
+    region_t    r;
+    int         i;
+
+    for (i = 0; i < last_frame.ndirty; i++)
+    {
+        r = last_frame.dirty[i];
+        r.y1 = r.y1 > tile->y1 ? r.y1 : tile->y1;
+        r.y2 = r.y2 < tile->y2 ? r.y2 : tile->y2;
+
+        if (r.y1 <= r.y2)
+        {
+            draw_region(tile, &r);
+        }
+    }
 }
 
 /*
- * Draw the current buffer on the screen.
+ * Split a buffer in the horizontal tiles of the renderer.
  * 
- * buffer: reference to the buffer to copy on screen.
+ * buffer: reference to the buffer to split.
  */
-static void draw_buffer_to_screen(BITMAP *buffer)
+static void split_buffer(BITMAP *buffer)
 {
-    blit(buffer, screen, 0, 0, 0, 0, buffer->w, buffer->h);
+    tile_t  *tile;
+    int     i;
+
+    for (i = 0; i < renderer.ntiles; i++)
+    {
+        tile = &(renderer.tile[i]);
+        if (tile->bmp != NULL)
+        {
+            destroy_bitmap(tile->bmp);
+        }
+
+        tile->y1 = i * ywin / renderer.ntiles;
+        tile->y2 = (i + 1) * ywin / renderer.ntiles - 1;
+        tile->bmp = create_sub_bitmap(buffer, 0, tile->y1,
+                                      xwin, tile->y2 - tile->y1 + 1);
+    }
+
+    renderer.buffer = buffer;
+}
+
+/*
+ * Allocate what the frames are drawn with, if not done yet: static
+ * layer, sprites and tiles of the buffer. Must be called with access
+ * to the environment.
+ * 
+ * buffer: reference to the buffer.
+ */
+static void prepare_frame(BITMAP *buffer)
+{
+    if (last_frame.layer == NULL)
+    {
+        compose_static_layer();
+        create_missile_sprites();
+    }
+
+    if (renderer.buffer != buffer)
+    {
+        split_buffer(buffer);
+    }
+}
+
+/*
+ * Draw on the buffer and on the screen only the regions changed since
+ * the last frame. The environment is accessed only to copy the active
+ * missiles and the score: the frame is drawn, and published in the
+ * shared memory, from the copy. With the helper tasks every tile
+ * is rendered in parallel, joined by the barriers before the copy on
+ * the screen.
+ * 
+ * buffer: reference to the buffer, holding the last frame.
+ */
+static void draw_frame(BITMAP *buffer)
+{
+    snapshot_t  *s;
+    region_t    *r;
+    int         i;
+
+    access_env(HIGH_ENV_PRIO, ENV_CALLER_DRAW);
+
+    prepare_frame(buffer);
+
+    take_snapshot();
+
+    release_env(HIGH_ENV_PRIO);
+
+    publish_snapshot(last_frame.next);
+
+    find_dirty_regions();
+
+    if (renderer.helpers)
+    {
+        pbarrier_wait(&renderer.start, NULL);
+        render_tile(&renderer.tile[0]);
+        pbarrier_wait(&renderer.done, NULL);
+    }
+    else
+    {
+        for (i = 0; i < renderer.ntiles; i++)
+        {
+            render_tile(&renderer.tile[i]);
+        }
+    }
+
+    s = last_frame.drawn;
+    last_frame.drawn = last_frame.next;
+    last_frame.next = s;
+
+    for (i = 0; i < last_frame.ndirty; i++)
+    {
+        r = &(last_frame.dirty[i]);
+        blit(buffer, screen, r->x1, r->y1, r->x1, r->y1,
+             r->x2 - r->x1 + 1, r->y2 - r->y1 + 1);
+    }
 }
 
 /********************************************************************
  * DISPLAY THREAD
 ********************************************************************/
 
+/*
+ * Set the period (and the relative deadline) of the display manager,
+ * limited between the period of the current mode (the period of the
+ * display class if nominal) and DISPLAY_MAX_STRETCH times that one.
+ * 
+ * period: new period (ms).
+ */
+static void set_display_period(int period)
+{
+    int task, min, max;
+
+    min = mode_display_period();
+    max = DISPLAY_MAX_STRETCH * class_period(DISPLAY_TASK);
+    period = period < min ? min : period;
+    period = period > max ? max : period;
+
+    if (period == display_rate.period)
+    {
+        return;
+    }
+
+    task = ptask_get_index();
+    ptask_set_period(task, period, MILLI);
+    ptask_set_deadline(task, period, MILLI);
+    edf_set_period(period);
+
+    display_rate.period = period;
+    if (period > display_rate.max_period)
+    {
+        display_rate.max_period = period;
+    }
+}
+
+/*
+ * Adapt the rate of the display manager to the load of the system. The
+ * system is overloaded if a missile task missed its deadline since the
+ * last job, or if the last job of the display manager (measured with
+ * tstat) used more than DISPLAY_MAX_LOAD of its period: then the frame
+ * is skipped and the period doubled. After DISPLAY_RECOVERY ms
+ * without overload the period is halved.
+ * 
+ * ~return: 1 if the frame must be drawn, else 0.
+ */
+static int adapt_display_rate()
+{
+    tspec   total;
+    ptime   exec;
+    long    misses;
+    int     overload;
+
+    if (!display_rate.enabled)
+    {
+        display_rate.drawn++;
+        return 1;
+    }
+
+    misses = __atomic_load_n(&missile_misses, __ATOMIC_RELAXED);
+    total = ptask_get_total(ptask_get_index());
+    exec = tspec_to(&total, MICRO);
+
+    overload = misses != display_rate.misses ||
+               exec - display_rate.exec >
+               display_rate.period * 1000 * DISPLAY_MAX_LOAD;
+
+    display_rate.misses = misses;
+    display_rate.exec = exec;
+
+    if (overload)
+    {
+        /* Simulation first: the time of this frame goes to the missiles. */
+        display_rate.calm = 0;
+        display_rate.skipped++;
+        set_display_period(2 * display_rate.period);
+        return 0;
+    }
+
+    display_rate.calm += display_rate.period;
+    if (display_rate.calm >= DISPLAY_RECOVERY)
+    {
+        display_rate.calm = 0;
+        set_display_period(display_rate.period / 2);
+    }
+
+    display_rate.drawn++;
+    return 1;
+}
+
 /*
  * Display manager task, responsible to write the current environment
- * state on screen on every cycle.
+ * state on screen on every cycle, redrawing only the changed regions.
+ * With the adaptive rate, frames are skipped under overload; with the
+ * overrun handling, the frame after one that overran is skipped.
  */
 static ptask display_manager(void)
 {
     BITMAP  *buffer;
-    buffer = create_bitmap(XWIN, YWIN);
+    int     frame, late;
+
+    buffer = ptask_get_argument();
+    frame = late = 0;
+
+    task_start(DISPLAY_TASK);
 
     while (!end)
     {
-        reset_buffer(buffer);
+        /* Without the adaptive rate the period follows the mode. */
+        set_display_period(display_rate.enabled ? display_rate.period
+                                                : mode_display_period());
 
-        draw_env(buffer);
+        /* A frame past its deadline skips the next one. */
+        if (late)
+        {
+            overrun_fallback();
+        }
+        else if (adapt_display_rate())
+        {
+            draw_frame(buffer);
 
-        draw_buffer_to_screen(buffer);
+            record(REC_TICK, 0, 0, 0, 0, frame++);
+        }
 
         check_deadline("- Display manager missed the deadline\n");
+        late = job_overrun();
+
+        task_wait_for_period();
+    }
 
-        ptask_wait_for_period();
+    /* Release the helper tasks waiting for the next frame. */
+    if (renderer.helpers)
+    {
+        renderer.stop = 1;
+        pbarrier_wait(&renderer.start, NULL);
     }
+
+    task_end();
+}
+
+/*
+ * Tile renderer helper task: renders its tile of every frame, between
+ * the barriers of the display manager.
+ */
+static ptask tile_renderer(void)
+{
+    tile_t  *tile;
+
+    tile = ptask_get_argument();
+
+    task_start(TILE_TASK);
+
+    while (1)
+    {
+        pbarrier_wait(&renderer.start, NULL);
+        if (renderer.stop)
+        {
+            break;
+        }
+
+        render_tile(tile);
+
+        pbarrier_wait(&renderer.done, NULL);
+    }
+
+    task_end();
+}
+
+/*
+ * Launch a helper task for every tile but the first one.
+ */
+static void launch_tile_renderers()
+{
+    tpars   params;
+    int     i, task;
+
+    renderer.helpers = renderer.ntiles - 1;
+    renderer.stop = 0;
+
+    if (!renderer.helpers)
+    {
+        return;
+    }
+
+    pbarrier_init(&renderer.start, renderer.ntiles);
+    pbarrier_init(&renderer.done, renderer.ntiles);
+
+    for (i = 1; i < renderer.ntiles; i++)
+    {
+        ptask_param_init(params);
+        ptask_param_period(params, class_period(DISPLAY_TASK), MILLI);
+        ptask_param_priority(params, TILE_PRIO);
+        ptask_param_activation(params, NOW);
+        ptask_param_argument(params, &(renderer.tile[i]));
+        place_task(&params, TILE_TASK);
+
+        task = ptask_create_param(tile_renderer, &params);
+
+        assert(task >= 0);
+    }
+
+    fprintf(stderr, "Created %i TILE renderers\n", renderer.helpers);
 }
 
 
@@ -909,29 +1955,109 @@ static ptask display_manager(void)
  * Initialize display manager task parameters.
  * 
  * params: reference to the parameters to initialize.
+ * buffer: reference to the buffer of the frames.
  */
-static void init_display_manager_params(tpars *params)
+static void init_display_manager_params(tpars *params, BITMAP *buffer)
 {
     ptask_param_init(*params);
-    ptask_param_deadline((*params), DISPLAY_DEADLINE, MILLI);
-    ptask_param_period((*params), DISPLAY_PERIOD, MILLI);
-    ptask_param_priority((*params), DISPLAY_PRIO);
+    ptask_param_deadline((*params), class_deadline(DISPLAY_TASK), MILLI);
+    ptask_param_period((*params), class_period(DISPLAY_TASK), MILLI);
+    ptask_param_priority((*params), class_priority(DISPLAY_TASK));
     ptask_param_activation((*params), NOW);
+    ptask_param_argument((*params), buffer);
+    edf_init_params(params);
+    admission_init_params(params);
+    place_task(params, DISPLAY_TASK);
+
+    /* The adaptive rate uses the execution time measured by tstat. */
+    if (display_rate.enabled)
+    {
+        ptask_param_measure((*params));
+    }
 }
 /*
  * Launch display manager task.
  */
 void launch_display_manager()
 {
-    int task;
-    tpars params;
+    int     task;
+    tpars   params;
+    BITMAP  *buffer;
+
+    /* Every bitmap is allocated before the tasks start. */
+    buffer = create_bitmap(xwin, ywin);
 
-    init_display_manager_params(&params);
+    access_env(HIGH_ENV_PRIO, ENV_CALLER_DRAW);
+    prepare_frame(buffer);
+    release_env(HIGH_ENV_PRIO);
+
+    init_display_manager_params(&params, buffer);
+
+    /* Helpers first: the first frame already waits for them. */
+    launch_tile_renderers();
 
     task = ptask_create_param(display_manager, &params);
 
     assert(task >= 0);
 
     fprintf(stderr, "Created DISPLAY manager with period: %i\n",
-            DISPLAY_PERIOD);
-}
\ No newline at end of file
+            class_period(DISPLAY_TASK));
+}
+
+/*
+ * Set the size of the window and of the environment.
+ */
+int set_world_size(int w, int h, int locked)
+{
+    if (w < MIN_XWIN || w > MAX_XWIN || h < MIN_YWIN || h > MAX_YWIN)
+    {
+        return 0;
+    }
+
+    /* The cells are already allocated with the current size. */
+    assert(env.cell == NULL || (w == xwin && h == ywin));
+
+    xwin = w;
+    ywin = h;
+    env.locked = locked;
+
+    return 1;
+}
+
+/*
+ * Enable the adaptive rate of the display manager.
+ */
+void set_adaptive_display(int enabled)
+{
+    display_rate.enabled = enabled;
+    display_rate.period = display_rate.max_period =
+        class_period(DISPLAY_TASK);
+    display_rate.calm = 0;
+    display_rate.misses = 0;
+    display_rate.exec = 0;
+    display_rate.drawn = display_rate.skipped = 0;
+}
+
+/*
+ * Set the number of horizontal tiles of a frame.
+ */
+void set_render_tiles(int tiles)
+{
+    tiles = tiles < 1 ? 1 : tiles;
+    renderer.ntiles = tiles > MAX_TILES ? MAX_TILES : tiles;
+}
+
+/*
+ * Print the report of the adaptive display rate, if enabled.
+ */
+void print_display_report(FILE *out)
+{
+    if (display_rate.enabled)
+    {
+        fprintf(out, "\n===== DISPLAY =====\n"
+                     "frames drawn %li, skipped %li (overload)\n"
+                     "period %i ms, longest %i ms\n",
+                display_rate.drawn, display_rate.skipped,
+                display_rate.period, display_rate.max_period);
+    }
+}
@@ -11,6 +11,7 @@
 #define GESTOR_H
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <semaphore.h>
 
 #include "launchers.h"
@@ -28,6 +29,12 @@
 #define MIDDLE_ENV_PRIO     1
 //  Highest priority for environment access.
 #define HIGH_ENV_PRIO       0
+// Scheduling priorities of the tasks tracked by the priority inheritance
+// of the environment (fixed priorities from 0 to 99).
+#define ENV_SCHED_PRIOS     100
+// Priority inherited from a SCHED_DEADLINE task blocked on the
+// environment: above every task of the system.
+#define ENV_DEADLINE_PRIO   (ENV_SCHED_PRIOS - 2)
 
 // Value of an empty cell inside the environment.
 #define EMPTY_CELL          -1
@@ -41,21 +48,41 @@
 
 // Refresh rate of the screen (updates per second)
 #define REFRESH_RATE        60
-// Period of the display manager task.
+// Period of the display manager task, unless loaded from the task
+// parameters file (calib.h), as the deadline and priority.
 #define DISPLAY_PERIOD      ((int)(1000 / REFRESH_RATE))
 // Priority of the display manager task.
 #define DISPLAY_PRIO        3
 // Relative deadline of the display manager task.
 #define DISPLAY_DEADLINE    (DISPLAY_PERIOD)
+// Maximum stretch of the period of the adaptive display manager task.
+#define DISPLAY_MAX_STRETCH 8
+// Fraction of its period the adaptive display manager can execute for
+// before slowing down.
+#define DISPLAY_MAX_LOAD    0.5
+// Time without overload before the adaptive display manager speeds up (ms).
+#define DISPLAY_RECOVERY    500
+// Maximum number of horizontal tiles of a frame, rendered in parallel.
+#define MAX_TILES           8
+// Priority of the tile renderer helper tasks.
+#define TILE_PRIO           1
 
-// Horizontal size of the window.
-#define XWIN                640
-// Vertical size of the window.
-#define YWIN                480
+// Default horizontal size of the window.
+#define DEFAULT_XWIN        640
+// Default vertical size of the window.
+#define DEFAULT_YWIN        480
+// Minimum size of the window, to fit the labels and the legend.
+#define MIN_XWIN            320
+#define MIN_YWIN            240
+// Maximum size of the window (the recorded coordinates are 16 bits).
+#define MAX_XWIN            16384
+#define MAX_YWIN            16384
+// Size of a huge page, used to allocate the environment.
+#define ENV_HUGEPAGE_SIZE   (2 * 1024 * 1024)
 // Thickness of the wall around the window.
 #define WALL_THICKNESS      2
 // Starting point of the goal for attacker missile.
-#define GOAL_START_Y        (YWIN * 0.8)
+#define GOAL_START_Y        (ywin * 0.8)
 
 // Background color of the display (0 = black).
 #define BKG_COLOR           0
@@ -77,9 +104,9 @@
 // Height of the rectangle used in the legend.
 #define RECT_H              8
 // Width of the rectangle used in the legend.
-#define RECT_W              ((int)(((float)RECT_H / (float)YWIN) * (float)XWIN))
+#define RECT_W              ((int)(((float)RECT_H / (float)ywin) * (float)xwin))
 // Horizontal starting point of the legend.
-#define LEGEND_X            (XWIN - 120)
+#define LEGEND_X            (xwin - 120)
 // Vertical starting point of the legend.
 #define LEGEND_Y            (TUTORIAL_Y + 20)
 // Height of the text labels, used to calculate vertical starting point.
@@ -87,9 +114,18 @@
 // Horizontal starting point of the text labels.
 #define LABEL_X             10
 // Get vertical starting point given the number of spaces (s).
-#define GET_Y_LABEL(s)      (YWIN - s * LABEL_H)
+#define GET_Y_LABEL(s)      (ywin - s * LABEL_H)
 // Spaces between lines in the legend.
 #define SPACING             2
+// Width of a character of the font.
+#define FONT_W              8
+// Width of the score labels.
+#define SCORE_W             (LABEL_LEN * FONT_W)
+// Maximum number of missiles on the screen.
+#define ENTITIES            (MISSILE_TYPES * N)
+// Maximum number of regions redrawn in a frame: old and new position
+// of every missile and the score.
+#define DIRTY_REGIONS       (2 * ENTITIES + 1)
 
 // X and Y coordinate for a point in 2D.
 typedef struct
@@ -97,6 +133,21 @@ typedef struct
     int x, y;
 }   pos_t;
 
+// Size of the window (and of the environment), chosen at startup.
+extern int  xwin, ywin;
+
+/*
+ * Set the size of the window and of the environment. Must be called
+ * before any other function of the environment.
+ * 
+ * w: horizontal size, from MIN_XWIN to MAX_XWIN.
+ * h: vertical size, from MIN_YWIN to MAX_YWIN.
+ * locked: 1 to allocate the environment on huge pages, if available,
+ * and lock it in memory, else 0.
+ * ~return: 1 if the size is valid, else 0.
+ */
+int set_world_size(int w, int h, int locked);
+
 /*
  * Initialize environment and display manager.
  */
@@ -107,6 +158,34 @@ void init_gestor();
  */
 void launch_display_manager();
 
+/*
+ * Enable the adaptive rate of the display manager: when the missile
+ * tasks miss their deadlines, or the display manager uses too much of
+ * its period, frames are skipped and the period is doubled; it is
+ * halved again after DISPLAY_RECOVERY ms without overload. Must be
+ * called before launching the display manager.
+ * 
+ * enabled: 1 to adapt the rate, else 0.
+ */
+void set_adaptive_display(int enabled);
+
+/*
+ * Set the number of horizontal tiles of a frame. The first tile is
+ * rendered by the display manager, every other one by a helper task
+ * launched with the display manager. Must be called before launching
+ * the display manager.
+ * 
+ * tiles: number of tiles, from 1 to MAX_TILES.
+ */
+void set_render_tiles(int tiles);
+
+/*
+ * Print the report of the adaptive display rate, if enabled.
+ * 
+ * out: output file.
+ */
+void print_display_report(FILE *out);
+
 /*
  * Check if a deadline was missed in the current task and print an informative
  * message.
@@ -116,6 +195,40 @@ void launch_display_manager();
  */
 void check_deadline(char *message);
 
+/*
+ * Get the name of a task class.
+ * 
+ * task_class: class of the task.
+ * ~return: name of the task class.
+ */
+char *task_class_name(task_class_t task_class);
+
+/*
+ * Start the body of the current task: prefault its stack, move it to
+ * its scheduling (EDF, partition), add it to the admitted set and
+ * signal it to the performance counters, the tracer, the shared memory
+ * export, the calibration and the overrun handling. Nothing is done in
+ * a coroutine, which runs in the job of its dispatcher.
+ * 
+ * task_class: class of the current task.
+ */
+void task_start(task_class_t task_class);
+
+/*
+ * End the body of the current task, undoing task_start. Nothing is
+ * done in a coroutine.
+ */
+void task_end();
+
+/*
+ * Wait for the next period of the current task, signaling the end of
+ * the current job (overrun handling, performance counters, modes,
+ * calibration, shared memory export, tracer) and the activation of the
+ * next one, suspended while the task is out of the current mode. A
+ * coroutine yields to its dispatcher until its next period.
+ */
+void task_wait_for_period();
+
 /*
  * Check if a deadline was missed by a messile task and print an informative
  * formatted string.
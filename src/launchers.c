@@ -25,6 +25,17 @@
 #include <time.h>
 #include <math.h>
 #include "gestor.h"
+#include "tracer.h"
+#include "recorder.h"
+#include "rtmem.h"
+#include "edf.h"
+#include "partition.h"
+#include "admission.h"
+#include "opmode.h"
+#include "overrun.h"
+#include "wheel.h"
+#include "coro.h"
+#include "calib.h"
 
 // Fifo queue gestor.
 typedef struct
@@ -38,7 +49,8 @@ typedef struct
     private_sem_t   read_sem;   // Private semaphore to extract a used element.
 }   fifo_queue_gestor_t;
 
-// Single missile queue gestor.
+// Single missile queue gestor: the queue ends on a cache line, so the
+// gestor written by the launcher does not share one with a missile.
 typedef struct
 {
     missile_t           queue[N];
@@ -56,6 +68,11 @@ typedef struct
 static missile_gestor_t atk_gestor;
 static missile_gestor_t def_gestor;
 
+// Starting parameters of the attacker missiles requested with a spec.
+static atk_spec_t       atk_specs[N];
+// Flags of the attacker missiles requested with a spec.
+static int              atk_spec_set[N];
+
 /********************************************************************
  * INITIALZATIONS
 ********************************************************************/
@@ -103,7 +120,6 @@ static void init_queue(fifo_queue_gestor_t *gestor)
  */
 static void init_empty_missile(missile_t *missile)
 {
-    sem_init(&missile->mutex, 0, 1);
     missile->deleted = 0;
     missile->speed = missile->angle = 0;
     missile->partial_x = missile->partial_y = 0;
@@ -158,14 +174,14 @@ void init_launchers()
 ********************************************************************/
 
 /*
- * Get deltatime based on current task's period.
+ * Get deltatime based on the period of a missile.
  * 
- * task_index: index of the task from which get the period.
+ * period: period of the missile (ms).
  * 
  */
-static float get_deltatime(int task_index, int unit)
+static float get_deltatime(int period)
 {
-    return (float)ptask_get_period(task_index, unit) / DELTA_FACTOR;
+    return (float)period / DELTA_FACTOR;
 }
 
 /*
@@ -195,7 +211,7 @@ static float frand(float min, float max)
  */
 static void update_queue_head(fifo_queue_gestor_t *gestor, int index)
 {
-    assert(index >= 0 && gestor->read_sem.blk > 0);
+    assert(index >= 0);
 
     gestor->next[index] = NONE;       // Added index will be the end of the queue.
     if (gestor->headIndex == NONE)    // Update head if was empty,
@@ -231,11 +247,54 @@ void request_atk_launch()
     {
         index = gestor->freeIndex;
         gestor->freeIndex = gestor->next[gestor->freeIndex];
+        atk_spec_set[index] = 0;            // Random starting parameters.
         update_queue_head(gestor, index);   // Get and indert an index in head.
         sem_post(&(gestor->read_sem).sem);  // Mutex passed to the waken reader.
     }
 }
 
+/*
+ * Request an attacker missile task launch with the given starting
+ * parameters. Differently from request_atk_launch the request is queued
+ * even if the attack launcher is busy, and the launcher does not wait
+ * between consecutive requests.
+ * 
+ * spec: reference to the starting parameters of the missile.
+ * ~return: 1 if the request was queued, 0 if the queue is full.
+ */
+int request_atk_launch_spec(atk_spec_t *spec)
+{
+    int                 index;
+    fifo_queue_gestor_t *gestor;
+
+    gestor = &(atk_gestor.gestor);
+
+    sem_wait(&(gestor->mutex));
+
+    if (gestor->freeIndex == NONE)
+    {
+        sem_post(&(gestor->mutex));
+        return 0;
+    }
+
+    index = gestor->freeIndex;
+    gestor->freeIndex = gestor->next[gestor->freeIndex];
+    atk_specs[index] = *spec;
+    atk_spec_set[index] = 1;
+    update_queue_head(gestor, index);
+
+    if (gestor->read_sem.blk)   // Mutex passed to the waken reader.
+    {
+        sem_post(&(gestor->read_sem).sem);
+    }
+    else
+    {
+        sem_post(&(gestor->mutex));
+    }
+
+    return 1;
+}
+
 /*
  * BLOCKING: Request a free index from the defender missile gestor.
  * Block if there are no free index available or if there are other
@@ -330,6 +389,20 @@ static void splice_index(fifo_queue_gestor_t *gestor, int index)
  * MISSILE FUNCTIONS
 ********************************************************************/
 
+/*
+ * Get a missile structure. The structure is read without locks, so
+ * it should be used only to observe the missile.
+ * 
+ * type: type of the missile.
+ * index: index of the missile.
+ * ~return: reference to the missile structure.
+ */
+missile_t *get_missile(missile_type_t type, int index)
+{
+    return type == ATTACKER ? &(atk_gestor.queue[index])
+                            : &(def_gestor.queue[index]);
+}
+
 /*
  * Assign a target index to an attacker missile task.
  * 
@@ -358,6 +431,9 @@ static void clear_missile(missile_t *missile, fifo_queue_gestor_t *gestor)
     sem_wait(&gestor->mutex);
 
     index = missile->index;
+    trace_instant(missile->missile_type == ATTACKER ? "atk_death"
+                                                    : "def_death", index);
+    record(REC_DEATH, missile->missile_type, index, missile->x, missile->y, 0);
     init_empty_missile(missile);
 
     splice_index(gestor, index);
@@ -387,84 +463,188 @@ static void move_missile(missile_t *missile, float deltatime)
     missile->y = (int)missile->partial_y;
 }
 
+/*
+ * Move a missile by one period and update the environment.
+ * 
+ * missile: reference to the missile structure to update.
+ * deltatime: deltatime between task activation.
+ * ~return: 1 if the missile collided, else 0.
+ */
+static int step_missile(missile_t *missile, float deltatime)
+{
+    int oldx, oldy;
+
+    oldx = missile->x;
+    oldy = missile->y;
+
+    move_missile(missile, deltatime);
+
+    return update_missile_env(missile, oldx, oldy);
+}
+
 /*
  * Missile task movement loop: update missile position until there
  * is a collision or the end is signaled.
  * 
  * missile: reference to the missile structure to update.
- * task_index: index of the missile task.
+ * period: period of the missile (ms).
  */
-static void task_missile_movement(missile_t *missile, int task_index)
+static void task_missile_movement(missile_t *missile, int period)
 {
-    int     oldx, oldy, collided;
+    int     collided;
     float   deltatime;
 
-    deltatime = get_deltatime(task_index, MILLI); // Task period doesn't change.
+    deltatime = get_deltatime(period);  // Task period doesn't change.
 
     do
     {
-        oldx = missile->x;
-        oldy = missile->y;
-
-        move_missile(missile, deltatime);
-        collided = update_missile_env(missile, oldx, oldy);
+        collided = step_missile(missile, deltatime);
 
         check_missile_deadline("- Missle type %i index %i missed the deadline \
                     (0: ATK, 1: DEF)\n", missile->missile_type, missile->index);
 
-        ptask_wait_for_period();
+        task_wait_for_period();
     } while (!collided && !end);
 }
 
+/*
+ * BLOCKING: Release the admission slot and the index of an ended
+ * missile, which can be launched again from then on.
+ * 
+ * arg: reference to the missile structure.
+ */
+static void end_missile(void *arg)
+{
+    missile_t   *missile;
+
+    missile = arg;
+
+    release_missile(missile->missile_type, missile->index);
+    clear_missile(missile, missile->missile_type == ATTACKER ?
+                           &atk_gestor.gestor : &def_gestor.gestor);
+}
+
+/*
+ * Missile movement run by a wheel dispatcher at every period of the
+ * missile, releasing the missile at its collision or at the end.
+ * 
+ * arg: reference to the missile structure to update.
+ * period: period of the missile (ms).
+ * ~return: 1 if the missile is released, else 0.
+ */
+static int wheel_missile_movement(void *arg, int period)
+{
+    missile_t   *missile;
+
+    missile = arg;
+
+    if (!step_missile(missile, get_deltatime(period)) && !end)
+    {
+        return 0;
+    }
+
+    end_missile(missile);
+
+    return 1;
+}
+
 /********************************************************************
  * ATTACK THREADS
 ********************************************************************/
 
+/*
+ * Get the stretch of the period of a new missile: the admitted one, or
+ * the one of the current mode if longer.
+ * 
+ * admitted: stretch given by the admission control.
+ * ~return: factor of the period and the deadline (1 if nominal).
+ */
+static int missile_stretch(int admitted)
+{
+    int mode;
+
+    mode = mode_missile_stretch();
+
+    return admitted > mode ? admitted : mode;
+}
+
 /*
  * Initialize the attack missile task parameters.
  * 
  * params: reference to the params to initialize.
  * arg: reference to an argument to pass to the task.
+ * stretch: factor of the period and the deadline (1 if nominal).
  */
-static void init_atk_params(tpars *params, void *arg)
+static void init_atk_params(tpars *params, void *arg, int stretch)
 {
+    stretch = missile_stretch(stretch);
+
     ptask_param_init(*params);
-    ptask_param_deadline((*params), ATK_MISSILE_DEADLINE, MILLI);
-    ptask_param_period((*params), ATK_MISSILE_PERIOD, MILLI);
-    ptask_param_priority((*params), ATK_MISSILE_PRIO);
+    ptask_param_deadline((*params),
+                         stretch * class_deadline(ATK_MISSILE_TASK), MILLI);
+    ptask_param_period((*params),
+                       stretch * class_period(ATK_MISSILE_TASK), MILLI);
+    ptask_param_priority((*params), class_priority(ATK_MISSILE_TASK));
     ptask_param_activation((*params), NOW);
     params->arg = arg;
+    edf_init_params(params);
+    admission_init_params(params);
+    place_task(params, ATK_MISSILE_TASK);
 }
 
 /*
- * Attacker missile task.
+ * Attacker missile body, run by its task or by its coroutine.
+ * 
+ * arg: reference to the missile structure.
+ * period: period of the missile (ms).
  */
-static ptask atk_thread(void)
+static void atk_body(void *arg, int period)
 {
     missile_t   *self;
-    int         task_index;
 
-    task_index = ptask_get_index();
-    self = ptask_get_argument();
+    self = arg;
+
+    task_start(ATK_MISSILE_TASK);
 
-    task_missile_movement(self, task_index);
+    task_missile_movement(self, period);
 
-    clear_missile(self, &atk_gestor.gestor);
+    /* A coroutine is still on its stack: its dispatcher releases it. */
+    if (!in_coro())
+    {
+        end_missile(self);
+    }
+
+    task_end();
+}
+
+/*
+ * Attacker missile task.
+ */
+static ptask atk_thread(void)
+{
+    atk_body(ptask_get_argument(), ptask_get_period(ptask_get_index(), MILLI));
 }
 
 /*
  * Launch a new attacker missile task given the missile structure.
  * 
  * missile: reference to the missile structure to associate with the task.
+ * stretch: factor of the period and the deadline (1 if nominal).
  * ~return: -1 if an error occurs with the task creation, else >0.
  */
-static int launch_atk_thread(missile_t *missile)
+static int launch_atk_thread(missile_t *missile, int stretch)
 {
     tpars   params;
+    int     task;
 
-    init_atk_params(&params, missile);
+    init_atk_params(&params, missile, stretch);
 
-    return ptask_create_param(atk_thread, &params);
+    /* The creation of a thread allocates by design. */
+    rt_alloc_begin();
+    task = ptask_create_param(atk_thread, &params);
+    rt_alloc_end();
+
+    return task;
 }
 
 /*
@@ -485,7 +665,7 @@ static void atk_wait()
  */
 static void set_random_start(missile_t *missile)
 {
-    missile->partial_x = (int)frand(0, XWIN);
+    missile->partial_x = (int)frand(0, xwin);
     missile->partial_y = WALL_THICKNESS + MISSILE_RADIUS + 1;
 
     missile->speed = frand(MIN_ATK_SPEED, MAX_ATK_SPEED);
@@ -498,6 +678,27 @@ static void set_random_start(missile_t *missile)
             missile->index, missile->speed);
 }
 
+/*
+ * Initialize attacker missile structure with the given parameters.
+ * 
+ * missile: reference to the missile structure to initialize.
+ * spec: reference to the starting parameters.
+ */
+static void set_spec_start(missile_t *missile, atk_spec_t *spec)
+{
+    missile->partial_x = (int)spec->x;
+    missile->partial_y = WALL_THICKNESS + MISSILE_RADIUS + 1;
+
+    missile->speed = spec->speed;
+    missile->angle = spec->angle;
+
+    missile->x = (int)missile->partial_x;
+    missile->y = (int)missile->partial_y;
+
+    fprintf(stderr, "ATK: Created %i with speed %f (scenario)\n",
+            missile->index, missile->speed);
+}
+
 /*
  * Initialize attacker missile structure.
  * 
@@ -509,23 +710,47 @@ static void init_atk_missile(missile_t *missile, int index)
     init_empty_missile(missile);
     missile->index = index;
     missile->missile_type = ATTACKER;
-    set_random_start(missile);
+
+    if (atk_spec_set[index])
+    {
+        set_spec_start(missile, &atk_specs[index]);
+    }
+    else
+    {
+        set_random_start(missile);
+    }
 }
 
 /*
  * Initialize structure and launch an attacker missile task.
  * 
  * index: index from the missile queue of the missile.
+ * stretch: factor of the period and the deadline (1 if nominal).
  */
-static void launch_atk_missile(int index)
+static void launch_atk_missile(int index, int stretch)
 {
     missile_t   *missile;
-    int         thread;
+    int         thread, period;
 
     missile = &(atk_gestor.queue[index]);
     init_atk_missile(missile, index);
 
-    thread = launch_atk_thread(missile);
+    trace_instant("atk_spawn", index);
+    record(REC_SPAWN, ATTACKER, index, missile->x, missile->y,
+           missile->speed * 1000);
+
+    /* With the dispatchers the missile is a coroutine or an entry of
+       their wheels. */
+    period = missile_stretch(stretch) * class_period(ATK_MISSILE_TASK);
+    if (coro_spawn(ATTACKER * N + index, period, atk_body, end_missile,
+                   missile) == 0 ||
+        wheel_add(ATTACKER * N + index, period,
+                  wheel_missile_movement, missile) == 0)
+    {
+        return;
+    }
+
+    thread = launch_atk_thread(missile, stretch);
 
     assert(thread >= 0);
 }
@@ -535,15 +760,44 @@ static void launch_atk_missile(int index)
  */
 static ptask atk_launcher()
 {
-    int index;
+    int index, burst, stretch;
+
+    task_start(ATK_LAUNCHER_TASK);
+
+    /* Attackers are not launched in the critical mode. */
+    mode_register_task(MODE_HIGH_LOAD);
 
     while (!end)
     {
         index = get_next_index(&atk_gestor.gestor); // Wait for an index to use.
-        launch_atk_missile(index);
-        atk_wait();
-        ptask_wait_for_period();
+        burst = atk_spec_set[index];
+
+        /* Out of the current mode: suspended until the system recovers. */
+        if (!task_in_mode())
+        {
+            task_wait_for_period();
+        }
+
+        /* Not admitted: the missile stays queued until the next period. */
+        while (!(stretch = admit_missile(ATTACKER, index)) && !end)
+        {
+            task_wait_for_period();
+        }
+
+        if (stretch)
+        {
+            launch_atk_missile(index, stretch);
+        }
+
+        /* Requests with a spec are launched in bursts. */
+        if (!burst)
+        {
+            atk_wait();
+            task_wait_for_period();
+        }
     }
+
+    task_end();
 }
 
 /*
@@ -551,12 +805,16 @@ static ptask atk_launcher()
  */
 void launch_atk_launcher()
 {
-    int task;
+    tpars   params;
+    int     task;
+
+    ptask_param_init(params);
+    ptask_param_deadline(params, class_deadline(ATK_LAUNCHER_TASK), MILLI);
+    ptask_param_period(params, class_period(ATK_LAUNCHER_TASK), MILLI);
+    ptask_param_priority(params, class_priority(ATK_LAUNCHER_TASK));
+    ptask_param_activation(params, NOW);
 
-    task = ptask_create_prio(atk_launcher,
-                             ATK_LAUNCHER_PERIOD,
-                             ATK_LAUNCHER_PRIO,
-                             NOW);
+    task = ptask_create_param(atk_launcher, &params);
 
     assert(task >= 0);
 
@@ -689,7 +947,7 @@ static int get_expected_position_x(trajectory_t *t, pos_t *current)
 
     /* Initialized with screen limits. */
     x_min = t->m < 0 ? WALL_THICKNESS + MISSILE_RADIUS + 1 : current->x;
-    x_max = t->m < 0 ? current->x : XWIN - WALL_THICKNESS - MISSILE_RADIUS - 1;
+    x_max = t->m < 0 ? current->x : xwin - WALL_THICKNESS - MISSILE_RADIUS - 1;
     i = 0;
 
     do
@@ -711,6 +969,31 @@ static int get_expected_position_x(trajectory_t *t, pos_t *current)
     return (int)x;
 }
 
+/*
+ * Estimate the intercept from the last known position of the target,
+ * without solving: the target is moved along its trajectory for the
+ * time the defender takes to reach its current height. Used when the
+ * solve is interrupted at the deadline.
+ *
+ * t: reference to the trajectory of the target missile.
+ * current: reference to the last position of the target.
+ * ~return: estimated x coordinate of the intersection.
+ */
+static int get_estimated_position_x(trajectory_t *t, pos_t *current)
+{
+    float   dist, x, x_min, x_max;
+
+    x_min = WALL_THICKNESS + MISSILE_RADIUS + 1;
+    x_max = xwin - WALL_THICKNESS - MISSILE_RADIUS - 1;
+
+    /* Distance of the target while the defender climbs, along x. */
+    dist = t->speed / DEF_MISSILE_SPEED *
+           fabs(DEF_MISSILE_START_Y - current->y) / sqrt(1 + t->m * t->m);
+    x = t->m < 0 ? current->x - dist : current->x + dist;
+
+    return (int)(x < x_min ? x_min : x > x_max ? x_max : x);
+}
+
 /*
  * Get the speed between two points in 2D space given the time.
  * 
@@ -741,7 +1024,8 @@ static float calc_dt(struct timespec t_start, struct timespec t_end)
 /*
  * Get starting and ending position of the target and mesure time. To
  * enhance the precision, keep collect samples until a given level of
- * precision or a loop limit is reached.
+ * precision or a loop limit (lower in the degraded modes) is reached,
+ * or until a sample overruns its deadline.
  * 
  * pos_a: reference to the starting position.
  * pos_b: reference to the ending position.
@@ -752,7 +1036,9 @@ static void collect_positions(pos_t *pos_a, pos_t *pos_b, int trgt, float *dt)
 {
     struct timespec t_start, t_end;
     float speed_a, speed_b;
-    int i;
+    int i, late;
+
+    trace_begin("collect_positions");
 
     clock_gettime(CLOCK_MONOTONIC, &t_start);       // Use absolute time.
     *pos_a = scan_env_for_target_pos(trgt);
@@ -768,11 +1054,20 @@ static void collect_positions(pos_t *pos_a, pos_t *pos_b, int trgt, float *dt)
         speed_b = calc_speed(pos_a, pos_b, *dt);
 
         check_deadline("- DEF Missle missed the deadline");
-        ptask_wait_for_period();                    // Let the target update.
+        late = job_overrun();
+        task_wait_for_period();                     // Let the target update.
         i++;
-    } while (i < SAMPLE_LIMIT &&                    // Check upper bound,
+    } while (!late &&                               // Stop on overrun,
+             i < mode_tracker_samples() &&          // check upper bound,
              (fabs(speed_b - speed_a) > EPSILON ||  // precision,
               i < MIN_SAMPLES || speed_b == 0));    // lower bound.
+
+    if (late)
+    {
+        overrun_fallback();
+    }
+
+    trace_end("collect_positions");
 }
 
 /*
@@ -804,7 +1099,19 @@ static int get_start_x_position(int target)
         fprintf(stderr, "DEF: Calculated speed for target %i: %f\n",
                 target, trajectory.speed);
 
-        expected_x = get_expected_position_x(&trajectory, &pos_b);
+        /* Interrupted at the deadline: estimated without solving. */
+        trace_begin("intercept_solve");
+        if (overrun_section())
+        {
+            expected_x = get_expected_position_x(&trajectory, &pos_b);
+            overrun_leave();
+        }
+        else
+        {
+            expected_x = get_estimated_position_x(&trajectory, &pos_b);
+            overrun_fallback();
+        }
+        trace_end("intercept_solve");
     }
 
     return expected_x;
@@ -825,23 +1132,51 @@ static void set_missile_trajectory(missile_t *missile, int start_x)
 }
 
 /*
- * Defender missile task.
+ * Defender missile body, run by its task or by its coroutine.
+ * 
+ * arg: reference to the missile structure.
+ * period: period of the missile (ms).
  */
-static ptask def_thread()
+static void def_body(void *arg, int period)
 {
     missile_t   *self;
-    int         start_x, task_index;
+    int         start_x;
+
+    self = arg;
 
-    task_index = ptask_get_index();
-    self = ptask_get_argument();
+    task_start(DEF_MISSILE_TASK);
 
     /* Expected intercept calculus done before start moving. */
     start_x = get_start_x_position(self->index);
     set_missile_trajectory(self, start_x);
+    record(REC_SPAWN, DEFENDER, self->index, self->x, self->y,
+           self->speed * 1000);
+
+    /* With the dispatchers the flight is an entry of their wheels. */
+    if (!in_coro() && wheel_add(DEFENDER * N + self->index, period,
+                                wheel_missile_movement, self) == 0)
+    {
+        task_end();
+        return;
+    }
+
+    task_missile_movement(self, period);
+
+    /* A coroutine is still on its stack: its dispatcher releases it. */
+    if (!in_coro())
+    {
+        end_missile(self);
+    }
 
-    task_missile_movement(self, task_index);
+    task_end();
+}
 
-    clear_missile(self, &def_gestor.gestor);
+/*
+ * Defender missile task.
+ */
+static ptask def_thread()
+{
+    def_body(ptask_get_argument(), ptask_get_period(ptask_get_index(), MILLI));
 }
 
 /*
@@ -849,15 +1184,23 @@ static ptask def_thread()
  * 
  * params: reference to the parameters to initialize.
  * arg: reference to a parameter to pass to the task.
+ * stretch: factor of the period and the deadline (1 if nominal).
  */
-static void init_def_params(tpars *params, void *arg)
+static void init_def_params(tpars *params, void *arg, int stretch)
 {
+    stretch = missile_stretch(stretch);
+
     ptask_param_init(*params);
-    ptask_param_deadline((*params), DEF_MISSILE_DEADLINE, MILLI);
-    ptask_param_period((*params), DEF_MISSILE_PERIOD, MILLI);
-    ptask_param_priority((*params), DEF_MISSILE_PRIO);
+    ptask_param_deadline((*params),
+                         stretch * class_deadline(DEF_MISSILE_TASK), MILLI);
+    ptask_param_period((*params),
+                       stretch * class_period(DEF_MISSILE_TASK), MILLI);
+    ptask_param_priority((*params), class_priority(DEF_MISSILE_TASK));
     ptask_param_activation((*params), NOW);
     params->arg = arg;
+    edf_init_params(params);
+    admission_init_params(params);
+    place_task(params, DEF_MISSILE_TASK);
 }
 
 /*
@@ -865,15 +1208,22 @@ static void init_def_params(tpars *params, void *arg)
  * 
  * 
  * missile: reference to the missile structure to associate with the task.
+ * stretch: factor of the period and the deadline (1 if nominal).
  * ~return: -1 if an error occurs with the task creation.
  */
-static int launch_def_thread(missile_t *missile)
+static int launch_def_thread(missile_t *missile, int stretch)
 {
     tpars   params;
+    int     task;
 
-    init_def_params(&params, missile);
+    init_def_params(&params, missile, stretch);
 
-    return ptask_create_param(def_thread, &params);
+    /* The creation of a thread allocates by design. */
+    rt_alloc_begin();
+    task = ptask_create_param(def_thread, &params);
+    rt_alloc_end();
+
+    return task;
 }
 
 /*
@@ -890,8 +1240,9 @@ static void init_def_missile(missile_t *missile, int index)
  * Initialize structure and launch an defender missile task.
  * 
  * index: index from the missile queue of the missile.
+ * stretch: factor of the period and the deadline (1 if nominal).
  */
-static void launch_def_missile(int index)
+static void launch_def_missile(int index, int stretch)
 {
     missile_t   *missile;
     int         thread;
@@ -899,7 +1250,17 @@ static void launch_def_missile(int index)
     missile = &(def_gestor.queue[index]);
     init_def_missile(missile, index);
 
-    thread = launch_def_thread(missile);
+    trace_instant("def_spawn", index);
+
+    /* With the coroutines the tracking runs on the dispatchers too. */
+    if (coro_spawn(DEFENDER * N + index,
+                   missile_stretch(stretch) * class_period(DEF_MISSILE_TASK),
+                   def_body, end_missile, missile) == 0)
+    {
+        return;
+    }
+
+    thread = launch_def_thread(missile, stretch);
 
     assert(thread >= 0);
 }
@@ -909,25 +1270,38 @@ static void launch_def_missile(int index)
  */
 static ptask def_launcher()
 {
-    int index;
+    int index, stretch;
+
+    task_start(DEF_LAUNCHER_TASK);
 
     index = request_def_index();
     do
     {
         /* If a valid index was acquired no need to get it again. */
         index = index >= 0 ? index : request_def_index();
-        if (search_screen_for_target(index))
+
+        /* Not admitted: the target stays untracked until the next period. */
+        stretch = admit_missile(DEFENDER, index);
+        if (stretch && search_screen_for_target(index))
         {
             fprintf(stderr, "DEF_LAUNCHER: Found target and assigned %i\n",
                     index);
-            launch_def_missile(index);
+            launch_def_missile(index, stretch);
             index = NONE; // Reset index to acquire a new one.
             def_wait();
         }
+        else if (stretch)
+        {
+            release_missile(DEFENDER, index);
+        }
+
+        rebalance_partitions();
 
-        ptask_wait_for_period();
+        task_wait_for_period();
 
     } while (!end);
+
+    task_end();
 }
 
 /*
@@ -935,12 +1309,16 @@ static ptask def_launcher()
  */
 void launch_def_launcher()
 {
-    int task;
+    tpars   params;
+    int     task;
+
+    ptask_param_init(params);
+    ptask_param_deadline(params, class_deadline(DEF_LAUNCHER_TASK), MILLI);
+    ptask_param_period(params, class_period(DEF_LAUNCHER_TASK), MILLI);
+    ptask_param_priority(params, class_priority(DEF_LAUNCHER_TASK));
+    ptask_param_activation(params, NOW);
 
-    task = ptask_create_prio(def_launcher,
-                             DEF_LAUNCHER_PERIOD,
-                             DEF_LAUNCHER_PRIO,
-                             NOW);
+    task = ptask_create_param(def_launcher, &params);
 
     assert(task >= 0);
 
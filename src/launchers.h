@@ -28,7 +28,9 @@
 // Delay between subsequent attack missile launches.
 #define ATK_SLEEP_DELAY         500 * 1000 * 1000 // 500 milliseconds
 
-// Period of the attack launcher task.
+// Period of the attack launcher task, unless loaded from the task
+// parameters file (calib.h), as the priorities and the parameters of
+// the missiles.
 #define ATK_LAUNCHER_PERIOD     60
 // Priority of the attack launcher task.
 #define ATK_LAUNCHER_PRIO       1
@@ -50,7 +52,9 @@
 // Delay between subsequent defender missile launches.
 #define DEF_SLEEP_DELAY         50 * 1000 * 1000 // 50 milliseconds
 
-// Period of the defender launcher task.
+// Period of the defender launcher task, unless loaded from the task
+// parameters file (calib.h), as the priorities and the parameters of
+// the missiles.
 #define DEF_LAUNCHER_PERIOD     40
 // Priority of the defender launcher task.
 #define DEF_LAUNCHER_PRIO       1
@@ -75,7 +79,8 @@
 typedef enum
 {
     ATTACKER,
-    DEFENDER
+    DEFENDER,
+    MISSILE_TYPES
 }   missile_type_t;
 
 // Private semaphore base structure.
@@ -86,7 +91,10 @@ typedef struct
     int     blk;    // Number of blocked threads.
 }   private_sem_t;
 
-// Single missile structure.
+// Single missile structure, in its own cache line: the missiles of
+// different tasks never share one. The kinematics, written by the task
+// on every period, come first; the metadata, written only on launch,
+// assignment and deletion, fill the rest of the line.
 typedef struct
 {
     int             x, y;                   // Position in the screen.
@@ -94,11 +102,18 @@ typedef struct
     float           angle;                  // Current angle of the missile.
     float           speed;                  // Current speed of the missile.
     int             index;                  // Index in the belonging queue.
-    int             deleted;                // Flag to delete a missile.
     int             assigned_target;        // Index assigned if discoveded.
-    sem_t           mutex;                  // Mutex for the structure.
+    int             deleted;                // Flag to delete a missile.
     missile_type_t  missile_type;           // Type of missile.
-}   missile_t;
+}   __attribute__((aligned(CACHE_LINE))) missile_t;
+
+// Starting parameters of an attacker missile.
+typedef struct
+{
+    float   x;                              // Horizontal starting point.
+    float   speed;                          // Speed of the missile.
+    float   angle;                          // Angle of the trajectory.
+}   atk_spec_t;
 
 /*
  * Initialize attacker and defender launchers.
@@ -128,6 +143,17 @@ void launch_def_launcher();
  */
 void request_atk_launch();
 
+/*
+ * Request an attacker missile task launch with the given starting
+ * parameters. Differently from request_atk_launch the request is queued
+ * even if the attack launcher is busy, and the launcher does not wait
+ * between consecutive requests.
+ * 
+ * spec: reference to the starting parameters of the missile.
+ * ~return: 1 if the request was queued, 0 if the queue is full.
+ */
+int request_atk_launch_spec(atk_spec_t *spec);
+
 /*
  * Delete an attacker missile.
  * 
@@ -159,4 +185,14 @@ void assign_target_to_atk(int index, int target);
  */
 int is_already_tracked(int target);
 
+/*
+ * Get a missile structure. The structure is read without locks, so
+ * it should be used only to observe the missile.
+ * 
+ * type: type of the missile.
+ * index: index of the missile.
+ * ~return: reference to the missile structure.
+ */
+missile_t *get_missile(missile_type_t type, int index);
+
 #endif
\ No newline at end of file
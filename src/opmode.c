@@ -0,0 +1,384 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the operating modes of the system.
+ *
+ * The mode manager task measures, every MODE_PERIOD ms, the deadline
+ * miss rate of the jobs and the CPU utilisation of the tasks (their
+ * execution time over the time of all the CPUs), and moves the system
+ * between three modes:
+ * - nominal: every task with its parameters;
+ * - high-load: longer display period, longer periods of the new
+ *   missiles and fewer samples of the target tracker;
+ * - critical: minimal display rate and defenders only, the attack
+ *   launcher is suspended and its requests stay queued.
+ * A mode is entered as soon as one of its thresholds is crossed, and
+ * left one step at a time after MODE_RECOVERY ms below them, so the
+ * system degrades in steps instead of missing every deadline at once.
+ *
+ * The parameters of a mode are read by the tasks at their next job,
+ * while a task out of the task set of the current mode (the tasks
+ * registered with mode_register_task) suspends itself at its period
+ * and is activated again by the mode manager when the system steps
+ * down.
+ *
+********************************************************************/
+
+#include "opmode.h"
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include "gestor.h"
+#include "launchers.h"
+#include "tracer.h"
+#include "calib.h"
+
+// Parameters of an operating mode.
+typedef struct
+{
+    char    *name;              // Name of the mode.
+    int     display_stretch;    // Stretch of the display period.
+    int     missile_stretch;    // Stretch of the period of new missiles.
+    int     tracker_samples;    // Maximum samples of the target tracker.
+}   mode_spec_t;
+
+// Operating modes.
+typedef struct
+{
+    int         enabled;                // Operating modes flag.
+    op_mode_t   mode;                   // Current mode.
+    op_mode_t   last[MAX_TASKS];        // Most degraded mode of a task.
+    int         waiting[MAX_TASKS];     // Tasks suspended by their mode.
+    int         ncpus;                  // Number of CPUs.
+    long        jobs;                   // Jobs ended.
+    long        misses;                 // Deadline misses.
+    long        busy;                   // Execution time of the jobs (ns).
+    long        last_jobs, last_misses; // Values at the last measure.
+    long        last_busy, last_time;   // Values at the last measure (ns).
+    int         calm;                   // Time below the thresholds (ms).
+    long        time_in[OP_MODES];      // Time spent in each mode (ms).
+    long        switches;               // Mode switches.
+    long        changes;                // Tasks activated again.
+}   opmode_t;
+
+static const mode_spec_t    mode_spec[OP_MODES] = {
+    {"nominal",     1,                      1,  SAMPLE_LIMIT},
+    {"high-load",   2,                      2,  SAMPLE_LIMIT / 2},
+    {"critical",    DISPLAY_MAX_STRETCH,    2,  MIN_SAMPLES}
+};
+
+static opmode_t             opmode;
+
+// Execution time of the current task at the end of its last job (ns).
+static __thread long        own_busy;
+
+/*
+ * Initialize the operating modes.
+ */
+void init_opmode(int enabled)
+{
+    int i;
+
+    memset(&opmode, 0, sizeof(opmode));
+    opmode.enabled = enabled;
+    opmode.mode = MODE_NOMINAL;
+    opmode.ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        opmode.last[i] = OP_MODES - 1;
+    }
+}
+
+/*
+ * Get the current time of a clock.
+ *
+ * clock: clock to read.
+ * ~return: time (ns).
+ */
+static long clock_ns(clockid_t clock)
+{
+    struct timespec t;
+
+    clock_gettime(clock, &t);
+
+    return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+/*
+ * Count the job of the current task and its execution time.
+ */
+void mode_job_end()
+{
+    long    busy;
+
+    if (!opmode.enabled)
+    {
+        return;
+    }
+
+    /* The clock of a thread starts from 0 at its creation. */
+    busy = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    __atomic_fetch_add(&opmode.busy, busy - own_busy, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&opmode.jobs, 1, __ATOMIC_RELAXED);
+    own_busy = busy;
+}
+
+/*
+ * Count a deadline miss of the current task.
+ */
+void mode_deadline_miss()
+{
+    if (opmode.enabled)
+    {
+        __atomic_fetch_add(&opmode.misses, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Measure the deadline miss rate and the utilisation since the last
+ * measure.
+ *
+ * miss_rate: reference to the misses over the ended jobs.
+ * util: reference to the execution time over the time of the CPUs.
+ */
+static void measure(float *miss_rate, float *util)
+{
+    long    jobs, misses, busy, now;
+
+    jobs = __atomic_load_n(&opmode.jobs, __ATOMIC_RELAXED);
+    misses = __atomic_load_n(&opmode.misses, __ATOMIC_RELAXED);
+    busy = __atomic_load_n(&opmode.busy, __ATOMIC_RELAXED);
+    now = clock_ns(CLOCK_MONOTONIC);
+
+    *miss_rate = jobs > opmode.last_jobs ?
+                 (misses - opmode.last_misses) /
+                 (float)(jobs - opmode.last_jobs) : 0;
+    *util = now > opmode.last_time ?
+            (busy - opmode.last_busy) /
+            ((float)(now - opmode.last_time) * opmode.ncpus) : 0;
+
+    opmode.last_jobs = jobs;
+    opmode.last_misses = misses;
+    opmode.last_busy = busy;
+    opmode.last_time = now;
+}
+
+/*
+ * Get the mode required by the load.
+ *
+ * miss_rate: deadline miss rate.
+ * util: utilisation of the CPUs.
+ * ~return: most degraded mode whose thresholds are crossed.
+ */
+static op_mode_t required_mode(float miss_rate, float util)
+{
+    if (miss_rate > MODE_CRITICAL_MISS_RATE || util > MODE_CRITICAL_UTIL)
+    {
+        return MODE_CRITICAL;
+    }
+    if (miss_rate > MODE_HIGH_MISS_RATE || util > MODE_HIGH_UTIL)
+    {
+        return MODE_HIGH_LOAD;
+    }
+    return MODE_NOMINAL;
+}
+
+/*
+ * Switch to a mode: its parameters are used by the tasks from their
+ * next job.
+ *
+ * mode: new mode.
+ */
+static void set_mode(op_mode_t mode)
+{
+    __atomic_store_n(&opmode.mode, mode, __ATOMIC_RELAXED);
+    opmode.switches++;
+
+    trace_instant("mode_switch", mode);
+    fprintf(stderr, "MODE: %s\n", mode_spec[mode].name);
+}
+
+/*
+ * Activate the tasks suspended by a previous mode that run in the
+ * current one. A task not yet blocked is activated at the next period
+ * of the manager.
+ */
+static void activate_task_set()
+{
+    int i;
+
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (__atomic_load_n(&opmode.waiting[i], __ATOMIC_ACQUIRE) &&
+            opmode.mode <= opmode.last[i] && ptask_activate(i) >= 0)
+        {
+            __atomic_store_n(&opmode.waiting[i], 0, __ATOMIC_RELEASE);
+            opmode.changes++;
+        }
+    }
+}
+
+/*
+ * Mode manager task: moves the system between the modes with the load.
+ */
+static ptask mode_manager()
+{
+    op_mode_t   target;
+    float       miss_rate, util;
+
+    task_start(MODE_TASK);
+
+    opmode.last_time = clock_ns(CLOCK_MONOTONIC);
+
+    while (!end)
+    {
+        task_wait_for_period();
+
+        measure(&miss_rate, &util);
+        target = required_mode(miss_rate, util);
+        opmode.time_in[opmode.mode] += MODE_PERIOD;
+
+        if (target > opmode.mode)
+        {
+            opmode.calm = 0;
+            set_mode(target);
+        }
+        else if (target < opmode.mode)
+        {
+            /* One step at a time, after MODE_RECOVERY ms. */
+            opmode.calm += MODE_PERIOD;
+            if (opmode.calm >= MODE_RECOVERY)
+            {
+                opmode.calm = 0;
+                set_mode(opmode.mode - 1);
+            }
+        }
+        else
+        {
+            opmode.calm = 0;
+        }
+
+        activate_task_set();
+
+        check_deadline("- Mode manager missed the deadline\n");
+    }
+
+    task_end();
+}
+
+/*
+ * Launch the mode manager task.
+ */
+void launch_mode_manager()
+{
+    tpars   params;
+    int     task;
+
+    if (!opmode.enabled)
+    {
+        return;
+    }
+
+    ptask_param_init(params);
+    ptask_param_deadline(params, MODE_PERIOD, MILLI);
+    ptask_param_period(params, MODE_PERIOD, MILLI);
+    ptask_param_priority(params, MODE_PRIO);
+    ptask_param_activation(params, NOW);
+
+    task = ptask_create_param(mode_manager, &params);
+
+    assert(task >= 0);
+
+    fprintf(stderr, "Created MODE manager with period: %i\n", MODE_PERIOD);
+}
+
+/*
+ * Register the current task in the modes up to the most degraded one.
+ */
+void mode_register_task(op_mode_t last)
+{
+    opmode.last[ptask_get_index()] = last;
+}
+
+/*
+ * Check if the current task runs in the current mode.
+ */
+int task_in_mode()
+{
+    if (!opmode.enabled)
+    {
+        return 1;
+    }
+
+    return __atomic_load_n(&opmode.mode, __ATOMIC_RELAXED) <=
+           opmode.last[ptask_get_index()];
+}
+
+/*
+ * Suspend the current task, if it is out of the current mode, until
+ * the mode manager activates it again.
+ */
+void mode_job_start()
+{
+    if (task_in_mode())
+    {
+        return;
+    }
+
+    __atomic_store_n(&opmode.waiting[ptask_get_index()], 1,
+                     __ATOMIC_RELEASE);
+    ptask_wait_for_activation();
+}
+
+/*
+ * Get the shortest period of the display manager in the current mode.
+ */
+int mode_display_period()
+{
+    return mode_spec[__atomic_load_n(&opmode.mode, __ATOMIC_RELAXED)]
+           .display_stretch * class_period(DISPLAY_TASK);
+}
+
+/*
+ * Get the stretch of the period of a new missile in the current mode.
+ */
+int mode_missile_stretch()
+{
+    return mode_spec[__atomic_load_n(&opmode.mode, __ATOMIC_RELAXED)]
+           .missile_stretch;
+}
+
+/*
+ * Get the maximum number of samples of the target tracker.
+ */
+int mode_tracker_samples()
+{
+    return mode_spec[__atomic_load_n(&opmode.mode, __ATOMIC_RELAXED)]
+           .tracker_samples;
+}
+
+/*
+ * Print the time spent in every mode and the switches.
+ */
+void print_opmode_report(FILE *out)
+{
+    int m;
+
+    if (!opmode.enabled)
+    {
+        return;
+    }
+
+    fprintf(out, "\n===== MODES =====\n"
+                 "mode switches %li, tasks activated again %li\n",
+            opmode.switches, opmode.changes);
+
+    for (m = 0; m < OP_MODES; m++)
+    {
+        fprintf(out, "%s: %.1f s\n", mode_spec[m].name,
+                opmode.time_in[m] / 1000.0);
+    }
+}
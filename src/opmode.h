@@ -0,0 +1,124 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the parameters of the operating modes and the
+ * function prototypes necessary to degrade the system under overload.
+ *
+********************************************************************/
+
+#ifndef OPMODE_H
+#define OPMODE_H
+
+#include <stdio.h>
+
+#include "patriots.h"
+#include "ptask.h"
+
+/********************************************************************
+ * MODE PARAMETERS
+********************************************************************/
+
+// Period of the mode manager task (ms).
+#define MODE_PERIOD             100
+// Priority of the mode manager task, above every other task.
+#define MODE_PRIO               4
+// Deadline miss rate (misses over jobs) entering the high-load mode.
+#define MODE_HIGH_MISS_RATE     0.01
+// Deadline miss rate entering the critical mode.
+#define MODE_CRITICAL_MISS_RATE 0.05
+// CPU utilisation of the tasks entering the high-load mode.
+#define MODE_HIGH_UTIL          0.7
+// CPU utilisation of the tasks entering the critical mode.
+#define MODE_CRITICAL_UTIL      0.9
+// Time below the thresholds of the current mode before stepping down
+// to the previous one (ms).
+#define MODE_RECOVERY           2000
+
+// Operating modes, from the nominal to the most degraded one.
+typedef enum
+{
+    MODE_NOMINAL,
+    MODE_HIGH_LOAD,
+    MODE_CRITICAL,
+    OP_MODES
+}   op_mode_t;
+
+/*
+ * Initialize the operating modes.
+ *
+ * enabled: 1 to switch mode with the load, else 0 (always nominal).
+ */
+void init_opmode(int enabled);
+
+/*
+ * Launch the mode manager task. Must be called after the library is
+ * initialized.
+ */
+void launch_mode_manager();
+
+/*
+ * Register the current task in the modes, up to the most degraded one
+ * it runs in: in the following modes the task is suspended at its
+ * period, until the system steps down again. A task not registered
+ * runs in every mode.
+ *
+ * last: most degraded mode of the task.
+ */
+void mode_register_task(op_mode_t last);
+
+/*
+ * Check if the current task runs in the current mode.
+ *
+ * ~return: 0 if the task is suspended at its next period, else 1.
+ */
+int task_in_mode();
+
+/*
+ * Suspend the current task, if it is out of the current mode, until
+ * the mode manager activates it again in a mode it runs in. The
+ * activation restarts the period of the task, so the jobs of the
+ * suspension are not recovered. Called at the start of every job.
+ */
+void mode_job_start();
+
+/*
+ * Count the job of the current task and its execution time, used for
+ * the utilisation. Called at the end of every job.
+ */
+void mode_job_end();
+
+/*
+ * Count a deadline miss of the current task.
+ */
+void mode_deadline_miss();
+
+/*
+ * Get the shortest period of the display manager in the current mode.
+ *
+ * ~return: period (ms).
+ */
+int mode_display_period();
+
+/*
+ * Get the stretch of the period of a new missile in the current mode.
+ *
+ * ~return: factor of the period and the deadline (1 if nominal).
+ */
+int mode_missile_stretch();
+
+/*
+ * Get the maximum number of samples of the target tracker in the
+ * current mode.
+ *
+ * ~return: number of samples, from MIN_SAMPLES to SAMPLE_LIMIT.
+ */
+int mode_tracker_samples();
+
+/*
+ * Print the time spent in every mode and the switches, if enabled.
+ *
+ * out: stream where the report is written.
+ */
+void print_opmode_report(FILE *out);
+
+#endif
@@ -0,0 +1,302 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the overrun handling of the defender and display
+ * tasks.
+ *
+ * Every handled task owns a POSIX timer, armed at the absolute
+ * deadline of each job and disarmed at its end, that sends
+ * OVERRUN_SIGNAL to the thread of the task, as the dle_timer of the
+ * library does. The timer of the library is not used: its check point
+ * is a function, so the jump would return into a frame that no longer
+ * exists, it prints on every job and its handler always jumps, even
+ * while the task holds the environment.
+ *
+ * When the deadline expires the job is marked as overrun. If the task
+ * is inside an interruptible section (pure computations, without locks
+ * or allocations) the handler jumps back to its start, where the task
+ * takes a cheaper path; elsewhere the task checks job_overrun at safe
+ * points:
+ * - defender missile: the intercept solve is interrupted and replaced
+ *   by an estimate from the last known position, and the tracking
+ *   stops at the first sample that overran;
+ * - display manager: the frame after an overrun is skipped. The frame
+ *   itself is not interrupted: it is drawn on the last frame, only in
+ *   its changed regions, and its tiles are joined by the helper tasks
+ *   at a barrier, so a frame left in the middle would corrupt the next
+ *   ones.
+ *
+ * A missile run as a coroutine (-C) shares the thread, and so the
+ * timer, of its dispatcher: its jobs are not handled, and always take
+ * the full path.
+ *
+********************************************************************/
+
+#include "overrun.h"
+#include <time.h>
+#include <string.h>
+#include <assert.h>
+#include "ptask.h"
+#include "gestor.h"
+#include "tracer.h"
+
+// Thread of a SIGEV_THREAD_ID timer, not named by older C libraries.
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id  _sigev_un._tid
+#endif
+
+// Overruns of a task class.
+typedef struct
+{
+    long    overruns;       // Jobs past their deadline.
+    long    interrupted;    // Interrupted sections.
+    long    fallbacks;      // Cheaper paths taken.
+}   overrun_class_t;
+
+// Overrun handling.
+typedef struct
+{
+    int             enabled;                    // Overrun handling flag.
+    overrun_class_t task_class[TASK_CLASSES];   // Overruns by class.
+}   overrun_t;
+
+// Overrun state of a task.
+typedef struct
+{
+    int                     handled;    // 1 if the task owns a timer.
+    task_class_t            task_class; // Class of the task.
+    timer_t                 timer;      // Timer at the deadline of the job.
+    volatile sig_atomic_t   expired;    // 1 if the deadline expired.
+    volatile sig_atomic_t   jumpable;   // 1 inside a section.
+    sigjmp_buf              point;      // Start of the section.
+}   own_overrun_t;
+
+static overrun_t                overrun;
+
+// Overrun state of the current task.
+static __thread own_overrun_t   own;
+
+/*
+ * Handler of the timer signal, run by the task whose deadline expired.
+ *
+ * signo: number of the signal.
+ */
+static void overrun_handler(int signo)
+{
+    own.expired = 1;
+    if (own.jumpable)
+    {
+        own.jumpable = 0;
+        siglongjmp(own.point, 1);
+    }
+}
+
+/*
+ * Initialize the overrun handling.
+ */
+void init_overrun(int enabled)
+{
+    struct sigaction    action;
+    int                 ret;
+
+    memset(&overrun, 0, sizeof(overrun));
+    overrun.enabled = enabled;
+
+    if (!enabled)
+    {
+        return;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = overrun_handler;
+    sigemptyset(&action.sa_mask);
+
+    ret = sigaction(OVERRUN_SIGNAL, &action, NULL);
+    assert(ret == 0);
+}
+
+/*
+ * Check if the tasks of a class are handled.
+ *
+ * task_class: class of the task.
+ * ~return: 1 for the defender missile and display tasks, else 0.
+ */
+static int overrun_class(task_class_t task_class)
+{
+    return task_class == DEF_MISSILE_TASK || task_class == DISPLAY_TASK;
+}
+
+/*
+ * Create the timer of the current task and arm it.
+ */
+void overrun_task_start(task_class_t task_class)
+{
+    struct sigevent ev;
+
+    if (!overrun.enabled || !overrun_class(task_class))
+    {
+        return;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.sigev_notify = SIGEV_THREAD_ID;
+    ev.sigev_signo = OVERRUN_SIGNAL;
+    ev.sigev_notify_thread_id = ptask_get_current()->tid;
+
+    if (timer_create(CLOCK_MONOTONIC, &ev, &own.timer) != 0)
+    {
+        return;
+    }
+
+    own.handled = 1;
+    own.task_class = task_class;
+
+    overrun_job_start();
+}
+
+/*
+ * Delete the timer of the current task.
+ */
+void overrun_task_end()
+{
+    if (own.handled)
+    {
+        own.handled = 0;
+        own.jumpable = 0;
+        timer_delete(own.timer);
+    }
+}
+
+/*
+ * Arm the timer at the deadline of the current job.
+ */
+void overrun_job_start()
+{
+    struct itimerspec   t;
+
+    if (!own.handled)
+    {
+        return;
+    }
+
+    /* The library keeps the deadline on the monotonic clock. */
+    memset(&t, 0, sizeof(t));
+    t.it_value = ptask_get_current()->dl;
+
+    own.expired = 0;
+    timer_settime(own.timer, TIMER_ABSTIME, &t, NULL);
+}
+
+/*
+ * Disarm the timer and count the overrun of the current job.
+ */
+void overrun_job_end()
+{
+    struct itimerspec   t;
+
+    if (!own.handled)
+    {
+        return;
+    }
+
+    memset(&t, 0, sizeof(t));
+    timer_settime(own.timer, 0, &t, NULL);
+
+    if (own.expired)
+    {
+        __atomic_fetch_add(&overrun.task_class[own.task_class].overruns, 1,
+                           __ATOMIC_RELAXED);
+        trace_instant("overrun", ptask_get_index());
+        own.expired = 0;
+    }
+}
+
+/*
+ * Check if the deadline of the current job expired.
+ */
+int job_overrun()
+{
+    return own.handled && own.expired;
+}
+
+/*
+ * Count a cheaper path taken by the current task.
+ */
+void overrun_fallback()
+{
+    if (own.handled)
+    {
+        __atomic_fetch_add(&overrun.task_class[own.task_class].fallbacks, 1,
+                           __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Get the jump point of the section of the current task.
+ */
+sigjmp_buf *overrun_point()
+{
+    return &own.point;
+}
+
+/*
+ * Enter the section of the current job.
+ */
+int overrun_enter()
+{
+    /* Jumpable first: a deadline expiring in between is not lost. */
+    own.jumpable = own.handled;
+    if (own.expired)
+    {
+        own.jumpable = 0;
+        return overrun_caught();
+    }
+
+    return 1;
+}
+
+/*
+ * Count an interrupted section of the current job.
+ */
+int overrun_caught()
+{
+    __atomic_fetch_add(&overrun.task_class[own.task_class].interrupted, 1,
+                       __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+/*
+ * Leave the section of the current job.
+ */
+void overrun_leave()
+{
+    own.jumpable = 0;
+}
+
+/*
+ * Print the overruns of every task class.
+ */
+void print_overrun_report(FILE *out)
+{
+    overrun_class_t *c;
+    int             i;
+
+    if (!overrun.enabled)
+    {
+        return;
+    }
+
+    fprintf(out, "\n===== OVERRUNS =====\n");
+
+    for (i = 0; i < TASK_CLASSES; i++)
+    {
+        c = &(overrun.task_class[i]);
+        if (overrun_class(i))
+        {
+            fprintf(out, "%s: overruns %li, interrupted %li, fallbacks %li\n",
+                    task_class_name(i), c->overruns, c->interrupted,
+                    c->fallbacks);
+        }
+    }
+}
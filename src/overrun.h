@@ -0,0 +1,120 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the parameters of the overrun handling and the
+ * function prototypes necessary to handle the jobs of the defender and
+ * display tasks still running at their deadline.
+ *
+********************************************************************/
+
+#ifndef OVERRUN_H
+#define OVERRUN_H
+
+#include <stdio.h>
+#include <signal.h>
+#include <setjmp.h>
+
+#include "patriots.h"
+
+/********************************************************************
+ * OVERRUN PARAMETERS
+********************************************************************/
+
+// Signal sent by the timer of a task at the deadline of its job.
+#define OVERRUN_SIGNAL      (SIGRTMIN + 1)
+
+/*
+ * Start an interruptible section of the current job, as the condition
+ * of an if: evaluates to 1, and to 0 again from the start of the
+ * section if the deadline of the job expires before overrun_leave (or
+ * already expired). The section must not hold any lock nor allocate
+ * memory, and the locals it changes are lost when interrupted.
+ */
+#define overrun_section()   (sigsetjmp(*overrun_point(), 1) ? \
+                             overrun_caught() : overrun_enter())
+
+/*
+ * Initialize the overrun handling and install the handler of the
+ * timer signal. Must be called before any task is created.
+ *
+ * enabled: 1 to arm a timer at the deadline of every job of the
+ * defender and display tasks, else 0.
+ */
+void init_overrun(int enabled);
+
+/*
+ * Create the timer of the current task, if its class is handled.
+ *
+ * task_class: class of the current task.
+ */
+void overrun_task_start(task_class_t task_class);
+
+/*
+ * Delete the timer of the current task.
+ */
+void overrun_task_end();
+
+/*
+ * Arm the timer of the current task at the absolute deadline of its
+ * current job. Called at the start of every job.
+ */
+void overrun_job_start();
+
+/*
+ * Disarm the timer of the current task and count the overrun of the
+ * job, if its deadline expired. Called at the end of every job.
+ */
+void overrun_job_end();
+
+/*
+ * Check if the deadline of the current job expired.
+ *
+ * ~return: 1 if expired, else 0 (always 0 if not enabled).
+ */
+int job_overrun();
+
+/*
+ * Count a cheaper path taken by the current task after an overrun
+ * (truncated tracking, estimated intercept, skipped frame).
+ */
+void overrun_fallback();
+
+/*
+ * Get the jump point of the interruptible section of the current task,
+ * used by overrun_section.
+ *
+ * ~return: reference to the jump point.
+ */
+sigjmp_buf *overrun_point();
+
+/*
+ * Enter the interruptible section of the current job, used by
+ * overrun_section.
+ *
+ * ~return: 1 if entered, 0 if the deadline already expired.
+ */
+int overrun_enter();
+
+/*
+ * Count an interrupted section of the current job, used by
+ * overrun_section.
+ *
+ * ~return: 0.
+ */
+int overrun_caught();
+
+/*
+ * Leave the interruptible section of the current job: from here the
+ * deadline only marks the job as overrun.
+ */
+void overrun_leave();
+
+/*
+ * Print the overruns and the cheaper paths of every task class, if
+ * enabled.
+ *
+ * out: stream where the report is written.
+ */
+void print_overrun_report(FILE *out);
+
+#endif
@@ -0,0 +1,336 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the partitioned scheduling mode.
+ *
+ * The library is initialized with the PARTITIONED policy, so every
+ * task runs on the single CPU given in its parameters. The missile,
+ * display and tile tasks are placed on the CPU with the lowest
+ * utilisation (worst-fit), reserving the utilisation of their class:
+ * the largest one measured (tstat WCET over period) by the terminated
+ * tasks of the class. The other tasks are created on the default CPU
+ * and only counted in its load.
+ *
+ * The rebalance, run periodically by the defender launcher, updates
+ * the utilisation of every task from its measured WCET and migrates a
+ * single task from the most to the least loaded CPU when they differ
+ * by more than PARTITION_IMBALANCE: only a task smaller than the
+ * difference is moved, so the difference always shrinks.
+ *
+********************************************************************/
+
+#include "partition.h"
+#include <string.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include "tstat.h"
+#include "gestor.h"
+
+// Task registered on a CPU.
+typedef struct
+{
+    int             active;     // 1 if the task is running.
+    int             cpu;        // CPU of the task.
+    float           util;       // Utilisation of the task.
+    task_class_t    task_class; // Class of the task.
+}   placed_task_t;
+
+// Placed tasks not started yet on a CPU.
+typedef struct
+{
+    float   util[TASK_CLASSES];     // Reserved utilisation by class.
+    int     tasks[TASK_CLASSES];    // Placed tasks by class.
+}   reserved_t;
+
+// Partitioned scheduling mode.
+typedef struct
+{
+    int             enabled;                        // Partitioned flag.
+    int             ncpus;                          // Number of used CPUs.
+    float           load[PARTITION_MAX_CPUS];       // Utilisation by CPU.
+    float           class_util[TASK_CLASSES];       // Measured by class.
+    reserved_t      reserved[PARTITION_MAX_CPUS];   // Not started, by CPU.
+    placed_task_t   task[MAX_TASKS];                // Tasks by index.
+    long            placed;                         // Placed tasks.
+    long            migrations;                     // Migrated tasks.
+    sem_t           mutex;                          // Mutex for the structure.
+}   partition_t;
+
+static partition_t  partition;
+
+/*
+ * Initialize the partitioned scheduling mode.
+ */
+void init_partition(int enabled)
+{
+    memset(&partition, 0, sizeof(partition));
+    partition.enabled = enabled;
+
+    partition.ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (partition.ncpus > PARTITION_MAX_CPUS)
+    {
+        partition.ncpus = PARTITION_MAX_CPUS;
+    }
+
+    sem_init(&partition.mutex, 0, 1);
+}
+
+/*
+ * Get the global policy of the library for the selected mode.
+ */
+global_policy partition_policy()
+{
+    return partition.enabled ? PARTITIONED : GLOBAL;
+}
+
+/*
+ * Check if the tasks of a class are placed with place_task.
+ *
+ * task_class: class of the task.
+ * ~return: 1 for the missile, display and tile tasks, else 0.
+ */
+static int placed_class(task_class_t task_class)
+{
+    return task_class == DISPLAY_TASK || task_class == TILE_TASK ||
+           task_class == ATK_MISSILE_TASK || task_class == DEF_MISSILE_TASK;
+}
+
+/*
+ * Get the utilisation expected for a task of a class.
+ *
+ * task_class: class of the task.
+ * ~return: measured utilisation of the class, or PARTITION_INITIAL_UTIL.
+ */
+static float class_util(task_class_t task_class)
+{
+    return partition.class_util[task_class] > 0 ?
+           partition.class_util[task_class] : PARTITION_INITIAL_UTIL;
+}
+
+/*
+ * Find the CPU with the lowest or the highest utilisation.
+ *
+ * highest: 1 for the most loaded CPU, 0 for the least loaded one.
+ * ~return: index of the CPU.
+ */
+static int find_cpu(int highest)
+{
+    int c, best;
+
+    best = 0;
+    for (c = 1; c < partition.ncpus; c++)
+    {
+        if (highest ? partition.load[c] > partition.load[best]
+                    : partition.load[c] < partition.load[best])
+        {
+            best = c;
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Get the utilisation measured by a task.
+ *
+ * task: index of the task.
+ * ~return: WCET over period, 0 if not measured.
+ */
+static float measured_util(int task)
+{
+    tspec   wcet;
+    int     period;
+
+    wcet = ptask_get_wcet(task);
+    period = ptask_get_period(task, MICRO);
+
+    return period > 0 ? tspec_to(&wcet, MICRO) / (float)period : 0;
+}
+
+/*
+ * Place a new task on the least loaded CPU.
+ */
+void place_task(tpars *params, task_class_t task_class)
+{
+    float   util;
+    int     cpu;
+
+    if (!partition.enabled)
+    {
+        return;
+    }
+
+    sem_wait(&partition.mutex);
+
+    cpu = find_cpu(0);
+    util = class_util(task_class);
+    partition.load[cpu] += util;
+    partition.reserved[cpu].util[task_class] += util;
+    partition.reserved[cpu].tasks[task_class]++;
+    partition.placed++;
+
+    sem_post(&partition.mutex);
+
+    ptask_param_processor((*params), cpu);
+    ptask_param_measure((*params));
+}
+
+/*
+ * Register the current task on its CPU.
+ */
+void partition_task_start(task_class_t task_class)
+{
+    placed_task_t   *t;
+    reserved_t      *r;
+    int             task;
+
+    if (!partition.enabled)
+    {
+        return;
+    }
+
+    task = ptask_get_index();
+
+    sem_wait(&partition.mutex);
+
+    t = &(partition.task[task]);
+    t->active = 1;
+    t->cpu = ptask_get_processor(task);
+    t->task_class = task_class;
+
+    /* A placed task takes its share of the reservations of its class on
+       its CPU: the last one takes the rest, so the load removed at the
+       end is exactly the reserved one. */
+    r = &(partition.reserved[t->cpu]);
+    if (placed_class(task_class) && r->tasks[task_class] > 0)
+    {
+        t->util = r->util[task_class] / r->tasks[task_class];
+        r->util[task_class] -= t->util;
+        r->tasks[task_class]--;
+    }
+    else
+    {
+        t->util = class_util(task_class);
+        partition.load[t->cpu] += t->util;
+    }
+
+    sem_post(&partition.mutex);
+}
+
+/*
+ * Remove the current task from its CPU.
+ */
+void partition_task_end()
+{
+    placed_task_t   *t;
+    float           util;
+    int             task;
+
+    if (!partition.enabled)
+    {
+        return;
+    }
+
+    task = ptask_get_index();
+    util = measured_util(task);
+
+    sem_wait(&partition.mutex);
+
+    t = &(partition.task[task]);
+    if (util > partition.class_util[t->task_class])
+    {
+        partition.class_util[t->task_class] = util;
+    }
+
+    partition.load[t->cpu] -= t->util;
+    t->active = 0;
+
+    sem_post(&partition.mutex);
+}
+
+/*
+ * Update the utilisation of the tasks and migrate a task if the CPUs
+ * are imbalanced.
+ */
+void rebalance_partitions()
+{
+    placed_task_t   *t;
+    float           util, diff;
+    int             i, hi, lo, move;
+
+    if (!partition.enabled || partition.ncpus < 2)
+    {
+        return;
+    }
+
+    sem_wait(&partition.mutex);
+
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        t = &(partition.task[i]);
+        util = t->active ? measured_util(i) : 0;
+        if (util > 0)
+        {
+            partition.load[t->cpu] += util - t->util;
+            t->util = util;
+        }
+    }
+
+    hi = find_cpu(1);
+    lo = find_cpu(0);
+    diff = partition.load[hi] - partition.load[lo];
+
+    /* The largest task smaller than the difference. */
+    move = NONE;
+    for (i = 0; i < MAX_TASKS && diff > PARTITION_IMBALANCE; i++)
+    {
+        t = &(partition.task[i]);
+        if (t->active && t->cpu == hi && t->util < diff &&
+            (move == NONE || t->util > partition.task[move].util))
+        {
+            move = i;
+        }
+    }
+
+    if (move != NONE && ptask_migrate_to(move, lo) == 0)
+    {
+        t = &(partition.task[move]);
+        partition.load[hi] -= t->util;
+        partition.load[lo] += t->util;
+        t->cpu = lo;
+        partition.migrations++;
+    }
+
+    sem_post(&partition.mutex);
+}
+
+/*
+ * Print the load of every CPU and the migrations.
+ */
+void print_partition_report(FILE *out)
+{
+    int c;
+
+    if (!partition.enabled)
+    {
+        return;
+    }
+
+    fprintf(out, "\n===== PARTITIONS =====\n"
+                 "placed tasks %li, migrations %li\n",
+            partition.placed, partition.migrations);
+
+    for (c = 0; c < partition.ncpus; c++)
+    {
+        fprintf(out, "    cpu %i: utilisation %.3f\n", c, partition.load[c]);
+    }
+
+    for (c = 0; c < TASK_CLASSES; c++)
+    {
+        if (partition.class_util[c] > 0)
+        {
+            fprintf(out, "%s: utilisation %.3f\n", task_class_name(c),
+                    partition.class_util[c]);
+        }
+    }
+}
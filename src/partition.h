@@ -0,0 +1,84 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the parameters of the partitioned scheduling
+ * mode and the function prototypes necessary to place the tasks on
+ * the CPUs and to rebalance them.
+ *
+********************************************************************/
+
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <stdio.h>
+
+#include "patriots.h"
+#include "ptask.h"
+
+/********************************************************************
+ * PARTITION PARAMETERS
+********************************************************************/
+
+// Maximum number of CPUs used for the placement.
+#define PARTITION_MAX_CPUS      64
+// Utilisation assumed for a task class not measured yet.
+#define PARTITION_INITIAL_UTIL  0.05
+// Difference of utilisation between the most and the least loaded CPU
+// that triggers a migration.
+#define PARTITION_IMBALANCE     0.2
+
+/*
+ * Initialize the partitioned scheduling mode. Must be called before
+ * the library is initialized.
+ *
+ * enabled: 1 to place every task on a single CPU, else 0.
+ */
+void init_partition(int enabled);
+
+/*
+ * Get the global policy of the library for the selected mode.
+ *
+ * ~return: PARTITIONED if enabled, else GLOBAL.
+ */
+global_policy partition_policy();
+
+/*
+ * Place a new task on the least loaded CPU (worst-fit), reserving the
+ * utilisation of its class, and enable the measure of its execution
+ * time. Nothing is done if the mode is not enabled.
+ *
+ * params: reference to the parameters of the task.
+ * task_class: class of the task.
+ */
+void place_task(tpars *params, task_class_t task_class);
+
+/*
+ * Register the current task on its CPU. The tasks not placed with
+ * place_task (created on the default CPU) add the utilisation of
+ * their class to the CPU.
+ *
+ * task_class: class of the current task.
+ */
+void partition_task_start(task_class_t task_class);
+
+/*
+ * Remove the current task from its CPU, adding its measured
+ * utilisation to its class.
+ */
+void partition_task_end();
+
+/*
+ * Update the utilisation of every task from its measured WCET and, if
+ * the CPUs are imbalanced by more than PARTITION_IMBALANCE, migrate a
+ * task from the most to the least loaded CPU.
+ */
+void rebalance_partitions();
+
+/*
+ * Print the load of every CPU and the migrations, if enabled.
+ *
+ * out: stream where the report is written.
+ */
+void print_partition_report(FILE *out);
+
+#endif
@@ -1,47 +1,327 @@
 
 #include "patriots.h"
 #include <allegro.h>
+#include <stdio.h>
+#include <unistd.h>
 #include "ptask.h"
 #include "launchers.h"
 #include "gestor.h"
+#include "profiler.h"
+#include "tracer.h"
+#include "perfcnt.h"
+#include "scenario.h"
+#include "recorder.h"
+#include "shmexport.h"
+#include "rtmem.h"
+#include "edf.h"
+#include "partition.h"
+#include "admission.h"
+#include "opmode.h"
+#include "overrun.h"
+#include "wheel.h"
+#include "coro.h"
+#include "calib.h"
+
+// Command line options of the system.
+typedef struct
+{
+    int     profile;    // Profile the environment lock contention.
+    char    *trace;     // Trace file, NULL if tracing is disabled.
+    int     markers;    // Write the trace events on the ftrace markers.
+    int     counters;   // Sample the performance counters of the tasks.
+    char    *scenario;  // Scenario file, NULL if not used.
+    char    *record;    // Record file, NULL if recording is disabled.
+    int     shm;        // Publish the state in shared memory.
+    int     adaptive;   // Adapt the display rate to the load.
+    int     tiles;      // Tiles of a frame, rendered in parallel.
+    int     xwin, ywin; // Size of the window.
+    int     locked;     // Environment on huge pages, locked in memory.
+    int     edf;        // Run the missile and display tasks under EDF.
+    int     partitioned; // Place every task on a single CPU.
+    int     admission;  // Test the schedulability before each missile.
+    int     modes;      // Switch the operating mode with the load.
+    int     overrun;    // Interrupt the jobs at their deadline.
+    int     wheel;      // Run the missiles in the wheel dispatchers.
+    int     coro;       // Run the missile bodies as coroutines.
+    char    *params;    // Task parameters file, NULL if not used.
+    char    *calib;     // Calibration output file, NULL if disabled.
+}   options_t;
 
 // Flag used to end all tasks loops.
 int end;
 
+/*
+ * Print the command line usage.
+ * 
+ * name: name of the executable.
+ */
+static void usage(char *name)
+{
+    fprintf(stderr, "Usage: %s [-p] [-t file] [-k] [-c] [-s file] [-r file] "
+                    "[-m] [-a] [-j tiles] [-g WxH] [-L] [-e] [-P] [-A] [-M] "
+                    "[-O] [-W] [-C] [-f file] [-T file]\n", name);
+    fprintf(stderr, "  -p: profile the environment lock contention\n");
+    fprintf(stderr, "  -t: write a Chrome trace of the tasks on file\n");
+    fprintf(stderr, "  -k: write the trace events on the ftrace markers\n");
+    fprintf(stderr, "  -c: sample the performance counters of the tasks\n");
+    fprintf(stderr, "  -s: launch the attack waves of the scenario file\n");
+    fprintf(stderr, "  -r: record the simulation state on file\n");
+    fprintf(stderr, "  -m: publish the state in shared memory\n");
+    fprintf(stderr, "  -a: adapt the display rate to the load\n");
+    fprintf(stderr, "  -j: render the frames in tiles, in parallel\n");
+    fprintf(stderr, "  -g: size of the window (default %ix%i)\n",
+            DEFAULT_XWIN, DEFAULT_YWIN);
+    fprintf(stderr, "  -L: environment on huge pages, locked in memory\n");
+    fprintf(stderr, "  -e: missile and display tasks under SCHED_DEADLINE\n");
+    fprintf(stderr, "  -P: partitioned scheduling, tasks placed on the CPUs\n");
+    fprintf(stderr, "  -A: admission control of the missile tasks\n");
+    fprintf(stderr, "  -M: degrade the operating mode under overload\n");
+    fprintf(stderr, "  -O: interrupt defender and display jobs at deadline\n");
+    fprintf(stderr, "  -W: run the missiles in a few timer wheel dispatchers\n");
+    fprintf(stderr, "  -C: run the missile bodies as coroutines (implies -W)\n");
+    fprintf(stderr, "  -f: load the task periods and priorities from file\n");
+    fprintf(stderr, "  -T: measure the tasks, write their parameters on file\n");
+}
+
+/*
+ * Parse the command line options.
+ * 
+ * argc: number of arguments.
+ * argv: array of arguments.
+ * opts: reference to the options to fill.
+ * ~return: 1 if the options are valid, else 0.
+ */
+static int parse_options(int argc, char **argv, options_t *opts)
+{
+    int c, ret;
+
+    opts->profile = 0;
+    opts->trace = NULL;
+    opts->markers = 0;
+    opts->counters = 0;
+    opts->scenario = NULL;
+    opts->record = NULL;
+    opts->shm = 0;
+    opts->adaptive = 0;
+    opts->tiles = 1;
+    opts->xwin = DEFAULT_XWIN;
+    opts->ywin = DEFAULT_YWIN;
+    opts->locked = 0;
+    opts->edf = 0;
+    opts->partitioned = 0;
+    opts->admission = 0;
+    opts->modes = 0;
+    opts->overrun = 0;
+    opts->wheel = 0;
+    opts->coro = 0;
+    opts->params = NULL;
+    opts->calib = NULL;
+    ret = 1;
+
+    while ((c = getopt(argc, argv, "pt:kcs:r:maj:g:LePAMOWCf:T:")) != -1)
+    {
+        switch (c)
+        {
+        case 'p':
+            opts->profile = 1;
+            break;
+        case 't':
+            opts->trace = optarg;
+            break;
+        case 'k':
+            opts->markers = 1;
+            break;
+        case 'c':
+            opts->counters = 1;
+            break;
+        case 's':
+            opts->scenario = optarg;
+            break;
+        case 'r':
+            opts->record = optarg;
+            break;
+        case 'm':
+            opts->shm = 1;
+            break;
+        case 'a':
+            opts->adaptive = 1;
+            break;
+        case 'j':
+            opts->tiles = atoi(optarg);
+            break;
+        case 'g':
+            if (sscanf(optarg, "%ix%i", &opts->xwin, &opts->ywin) != 2)
+            {
+                ret = 0;
+            }
+            break;
+        case 'L':
+            opts->locked = 1;
+            break;
+        case 'e':
+            opts->edf = 1;
+            break;
+        case 'P':
+            opts->partitioned = 1;
+            break;
+        case 'A':
+            opts->admission = 1;
+            break;
+        case 'M':
+            opts->modes = 1;
+            break;
+        case 'O':
+            opts->overrun = 1;
+            break;
+        case 'W':
+            opts->wheel = 1;
+            break;
+        case 'C':
+            opts->coro = opts->wheel = 1;
+            break;
+        case 'f':
+            opts->params = optarg;
+            break;
+        case 'T':
+            opts->calib = optarg;
+            break;
+        default:
+            ret = 0;
+            break;
+        }
+    }
+
+    /* The size is needed by the scenario to check the starting x. */
+    if (ret && !set_world_size(opts->xwin, opts->ywin, opts->locked))
+    {
+        fprintf(stderr, "Invalid size: from %ix%i to %ix%i\n",
+                MIN_XWIN, MIN_YWIN, MAX_XWIN, MAX_YWIN);
+        ret = 0;
+    }
+
+    /* An invalid scenario is reported before starting the system. */
+    if (ret && opts->scenario != NULL)
+    {
+        ret = load_scenario(opts->scenario);
+    }
+
+    /* A pinned task is refused by SCHED_DEADLINE without an exclusive
+       cpuset: the EDF tasks would silently keep their priorities. */
+    if (ret && opts->edf && opts->partitioned)
+    {
+        fprintf(stderr, "The EDF tasks (-e) cannot be pinned: "
+                        "not with -P\n");
+        ret = 0;
+    }
+
+    /* The missiles of the dispatchers are not measured by the jobs. */
+    if (ret && opts->calib != NULL && opts->wheel)
+    {
+        fprintf(stderr, "The calibration (-T) needs the missile tasks: "
+                        "not with -W or -C\n");
+        ret = 0;
+    }
+
+    /* Before the initialization: the modules read the parameters. */
+    if (ret && opts->params != NULL)
+    {
+        ret = load_task_params(opts->params);
+    }
+
+    return ret;
+}
+
 /*
  * Initialize all system.
+ * 
+ * opts: reference to the command line options.
  */
-void init()
+void init(options_t *opts)
 {
     end = 0;
 
+    /* Locked first: every page touched by the startup stays resident. */
+    init_rtmem();
+
+    init_profiler(opts->profile);
+    init_tracer(opts->trace, opts->markers);
+    init_perfcnt(opts->counters);
+    init_recorder(opts->record);
+    init_shmexport(opts->shm);
+    init_edf(opts->edf);
+    init_partition(opts->partitioned);
+    init_admission(opts->admission, opts->edf);
+    init_opmode(opts->modes);
+    init_overrun(opts->overrun);
+    init_wheel(opts->wheel);
+    init_coro(opts->coro);
+    init_calib(opts->calib);
+
     init_gestor();
+    set_adaptive_display(opts->adaptive);
+    set_render_tiles(opts->tiles);
 
     init_launchers();
 
-    ptask_init(SCHED_RR, GLOBAL, NO_PROTOCOL);
+    ptask_init(SCHED_RR, partition_policy(), PRIO_INHERITANCE);
 }
 
 /*
- * Spawn main tasks: display, defender and attacker launchers.
+ * Spawn main tasks: mode manager, display, wheel dispatchers, defender
+ * and attacker launchers and the scenario loader.
  */
 void spawn_tasks()
 {
+    /* First: the attacker launcher is registered in its modes. */
+    launch_mode_manager();
+
     launch_display_manager();
+    launch_wheel_dispatchers();
 
     launch_def_launcher();
     launch_atk_launcher();
+
+    launch_scenario_loader();
+}
+
+/*
+ * Print the reports collected during the execution.
+ */
+void report()
+{
+    print_profiler_report(stderr);
+    print_perfcnt_report(stderr);
+    print_scenario_report(stderr);
+    print_display_report(stderr);
+    print_edf_report(stderr);
+    print_partition_report(stderr);
+    print_admission_report(stderr);
+    print_opmode_report(stderr);
+    print_overrun_report(stderr);
+    print_wheel_report(stderr);
+    print_calib_report(stderr);
+    print_rtmem_report(stderr);
+    flush_recorder();
+    close_shmexport();
+    flush_tracer();
 }
 
 /*
  * Main function, responsible to initializing the system, spawning
  * the main tasks and check for keyboard events.
  */
-int main(void)
+int main(int argc, char **argv)
 {
-    int c, k;
+    int         c, k;
+    options_t   opts;
+
+    if (!parse_options(argc, argv, &opts))
+    {
+        usage(argv[0]);
+        return 1;
+    }
 
-    init();
+    init(&opts);
 
     spawn_tasks();
 
@@ -62,5 +342,8 @@ int main(void)
 
     end = 1;
     allegro_exit();
+
+    report();
+
     return 0;
 }
\ No newline at end of file
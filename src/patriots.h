@@ -13,12 +13,29 @@
 #define NANOSECOND_TO_SECONDS   1000000000.0
 // Maximum length of string of text in informative messages.
 #define INFO_LEN                150
+// Size of a cache line, used to align the data written by different tasks.
+#define CACHE_LINE              64
 
 // Missile radius, used for draw a missile and check collisions.
 #define MISSILE_RADIUS          5
 // Max number of missile threads -> Size of the queue.
 #define N                       4
 
+// Classes of the tasks of the system.
+typedef enum
+{
+    DISPLAY_TASK,
+    ATK_LAUNCHER_TASK,
+    ATK_MISSILE_TASK,
+    DEF_LAUNCHER_TASK,
+    DEF_MISSILE_TASK,
+    SCENARIO_TASK,
+    TILE_TASK,
+    MODE_TASK,
+    WHEEL_TASK,
+    TASK_CLASSES
+}   task_class_t;
+
 // Flag used to end all tasks loops.
 extern int end;
 
@@ -0,0 +1,313 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the hardware performance counters sampler.
+ *
+ * Every task opens, at the start of its body, a group of counters
+ * with perf_event_open that follows only its own thread. At the end
+ * of every job the group is read with a single system call and the
+ * increments are added to the totals of the task class with atomic
+ * operations. The totals are printed when the system ends.
+ *
+ * Counters that are not supported by the machine (for example the
+ * hardware counters inside a virtual machine) are skipped.
+ *
+********************************************************************/
+
+#include "perfcnt.h"
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "gestor.h"
+
+// Counters of a single task.
+typedef struct
+{
+    int             active;                 // 1 if the counters are open.
+    int             leader;                 // Group leader descriptor.
+    int             fd[PERF_COUNTERS];      // File descriptor or NONE.
+    int             nopen;                  // Number of open counters.
+    uint64_t        last[PERF_COUNTERS];    // Values at the last sample.
+    task_class_t    task_class;             // Class of the task.
+}   task_counters_t;
+
+// Counters accumulated for a task class.
+typedef struct
+{
+    uint64_t    value[PERF_COUNTERS];   // Accumulated counters.
+    uint64_t    jobs;                   // Number of sampled jobs.
+    uint64_t    tasks;                  // Number of measured tasks.
+    uint64_t    missing;                // Tasks without some counter.
+}   class_counters_t;
+
+// Performance counters sampler.
+typedef struct
+{
+    int                 enabled;                    // Sampling flag.
+    class_counters_t    task_class[TASK_CLASSES];   // Totals by class.
+}   perfcnt_t;
+
+static perfcnt_t                perf;
+
+static __thread task_counters_t own;
+
+// Type and configuration of each counter.
+static const uint32_t   counter_type[PERF_COUNTERS] = {
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_SOFTWARE
+};
+
+static const uint64_t   counter_config[PERF_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_SW_CONTEXT_SWITCHES
+};
+
+// Names of the counters, used in the report.
+static char             *counter_names[PERF_COUNTERS] = {
+    "cycles",
+    "instructions",
+    "cache-misses",
+    "branch-misses",
+    "context-switches"
+};
+
+/********************************************************************
+ * COUNTERS MANAGEMENT
+********************************************************************/
+
+/*
+ * Initialize the performance counters sampler.
+ */
+void init_perfcnt(int enabled)
+{
+    memset(&perf, 0, sizeof(perf));
+    perf.enabled = enabled;
+}
+
+/*
+ * Open a counter of the current thread.
+ *
+ * counter: counter to open.
+ * group: file descriptor of the group leader, or -1 to create a group.
+ * ~return: file descriptor of the counter, -1 if not supported.
+ */
+static int open_counter(perf_counter_t counter, int group)
+{
+    struct perf_event_attr  attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter_type[counter];
+    attr.config = counter_config[counter];
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = group < 0;          // The leader starts the group.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    /* Context switches happen in the kernel, so they must be included. */
+    if (counter == PERF_CONTEXT_SWITCHES)
+    {
+        attr.exclude_kernel = 0;
+    }
+
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/*
+ * Read the counters of the current task.
+ *
+ * values: array where the values are written, indexed by counter.
+ * ~return: 1 if the counters were read, else 0.
+ */
+static int read_counters(uint64_t *values)
+{
+    uint64_t    buf[PERF_COUNTERS + 1];
+    int         c, n;
+
+    if (read(own.leader, buf, sizeof(buf)) <= 0)
+    {
+        return 0;
+    }
+
+    /* Values are in the order the counters were added to the group. */
+    n = 1;
+    for (c = 0; c < PERF_COUNTERS; c++)
+    {
+        values[c] = own.fd[c] >= 0 && n <= buf[0] ? buf[n++] : 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Open the counters of the current task.
+ */
+void perfcnt_task_start(task_class_t task_class)
+{
+    int c;
+
+    own.active = 0;
+
+    if (!perf.enabled)
+    {
+        return;
+    }
+
+    own.task_class = task_class;
+    own.leader = NONE;
+    own.nopen = 0;
+
+    for (c = 0; c < PERF_COUNTERS; c++)
+    {
+        own.fd[c] = open_counter(c, own.leader);
+        if (own.fd[c] >= 0)
+        {
+            own.leader = own.leader >= 0 ? own.leader : own.fd[c];
+            own.nopen++;
+        }
+        else
+        {
+            own.fd[c] = NONE;
+        }
+    }
+
+    __atomic_fetch_add(&perf.task_class[task_class].tasks, 1,
+                       __ATOMIC_RELAXED);
+
+    if (own.nopen < PERF_COUNTERS)
+    {
+        __atomic_fetch_add(&perf.task_class[task_class].missing, 1,
+                           __ATOMIC_RELAXED);
+    }
+
+    if (own.leader >= 0)
+    {
+        ioctl(own.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        own.active = read_counters(own.last);
+    }
+}
+
+/*
+ * Accumulate the counters of the current task in its class, at the end
+ * of a job.
+ */
+void perfcnt_sample()
+{
+    class_counters_t    *cls;
+    uint64_t            values[PERF_COUNTERS];
+    int                 c;
+
+    if (!own.active || !read_counters(values))
+    {
+        return;
+    }
+
+    cls = &(perf.task_class[own.task_class]);
+
+    for (c = 0; c < PERF_COUNTERS; c++)
+    {
+        __atomic_fetch_add(&cls->value[c], values[c] - own.last[c],
+                           __ATOMIC_RELAXED);
+        own.last[c] = values[c];
+    }
+
+    __atomic_fetch_add(&cls->jobs, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Accumulate and close the counters of the current task.
+ */
+void perfcnt_task_end()
+{
+    int c;
+
+    if (!perf.enabled)
+    {
+        return;
+    }
+
+    perfcnt_sample();
+
+    for (c = 0; c < PERF_COUNTERS; c++)
+    {
+        if (own.fd[c] >= 0)
+        {
+            close(own.fd[c]);
+            own.fd[c] = NONE;
+        }
+    }
+
+    own.active = 0;
+}
+
+/********************************************************************
+ * REPORT
+********************************************************************/
+
+/*
+ * Print the counters accumulated for each task class.
+ */
+void print_perfcnt_report(FILE *out)
+{
+    class_counters_t    *cls;
+    int                 t, c;
+    double              instr, cycles;
+
+    if (!perf.enabled)
+    {
+        return;
+    }
+
+    fprintf(out, "\n===== PERFORMANCE COUNTERS =====\n");
+
+    for (t = 0; t < TASK_CLASSES; t++)
+    {
+        cls = &(perf.task_class[t]);
+        if (!cls->tasks)
+        {
+            continue;
+        }
+
+        fprintf(out, "%s: %llu tasks, %llu jobs",
+                task_class_name(t), (unsigned long long)cls->tasks,
+                (unsigned long long)cls->jobs);
+        if (cls->missing)
+        {
+            fprintf(out, " (%llu tasks without some counter)",
+                    (unsigned long long)cls->missing);
+        }
+        fputs("\n", out);
+
+        for (c = 0; c < PERF_COUNTERS; c++)
+        {
+            fprintf(out, "    %-18s %16llu", counter_names[c],
+                    (unsigned long long)cls->value[c]);
+            if (cls->jobs)
+            {
+                fprintf(out, " (%.1f/job)",
+                        (double)cls->value[c] / cls->jobs);
+            }
+            fputs("\n", out);
+        }
+
+        instr = cls->value[PERF_INSTRUCTIONS];
+        cycles = cls->value[PERF_CYCLES];
+        if (instr > 0 && cycles > 0)
+        {
+            fprintf(out, "    IPC %.3f, cache-misses/kinstr %.3f, "
+                         "branch-misses/kinstr %.3f\n",
+                    instr / cycles,
+                    1000.0 * cls->value[PERF_CACHE_MISSES] / instr,
+                    1000.0 * cls->value[PERF_BRANCH_MISSES] / instr);
+        }
+    }
+}
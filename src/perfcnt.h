@@ -0,0 +1,60 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the declarations of the hardware performance
+ * counters sampler and the function prototypes necessary to measure
+ * the tasks and report the counters of each task class.
+ *
+********************************************************************/
+
+#ifndef PERFCNT_H
+#define PERFCNT_H
+
+#include <stdio.h>
+
+#include "patriots.h"
+
+// Counters sampled for each task.
+typedef enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    PERF_COUNTERS
+}   perf_counter_t;
+
+/*
+ * Initialize the performance counters sampler.
+ *
+ * enabled: 1 to sample the counters of the tasks, else 0.
+ */
+void init_perfcnt(int enabled);
+
+/*
+ * Open the counters of the current task.
+ *
+ * task_class: class of the current task.
+ */
+void perfcnt_task_start(task_class_t task_class);
+
+/*
+ * Accumulate the counters of the current task in its class, at the end
+ * of a job.
+ */
+void perfcnt_sample();
+
+/*
+ * Accumulate and close the counters of the current task.
+ */
+void perfcnt_task_end();
+
+/*
+ * Print the counters accumulated for each task class.
+ *
+ * out: stream where the report is written.
+ */
+void print_perfcnt_report(FILE *out);
+
+#endif
@@ -0,0 +1,337 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the environment lock contention profiler.
+ *
+ * Every access to the environment records, for its priority and
+ * its caller, the time spent waiting for the access, the time the
+ * environment was held and the number of tasks found ahead in the
+ * queue. Times are taken with the timestamp counter of the cpu,
+ * calibrated once at startup, and collected in logarithmic
+ * histograms that are printed when the system ends.
+ *
+ * The counters are updated with atomic operations, so more tasks
+ * with the same priority and caller can record concurrently.
+ *
+********************************************************************/
+
+#include "profiler.h"
+#include <time.h>
+#include "gestor.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Histograms of a single (priority, caller) couple.
+typedef struct
+{
+    uint64_t    count;                      // Number of accesses.
+    uint64_t    wait_total, wait_max;       // Waiting times (ns).
+    uint64_t    hold_total, hold_max;       // Holding times (ns).
+    uint64_t    wait[PROF_TIME_BUCKETS];    // Waiting time histogram.
+    uint64_t    hold[PROF_TIME_BUCKETS];    // Holding time histogram.
+    uint64_t    depth[PROF_DEPTH_BUCKETS];  // Queue depth histogram.
+}   prof_entry_t;
+
+// Profiler of the environment accesses.
+typedef struct
+{
+    int             enabled;                        // Recording flag.
+    double          ns_per_tick;                    // Timestamp resolution.
+    prof_entry_t    entry[ENV_PRIOS][ENV_CALLERS];  // Recorded accesses.
+}   profiler_t;
+
+static profiler_t   prof;
+
+// Names of the callers, used in the report.
+static char         *caller_names[ENV_CALLERS] = {
+    "draw_frame",
+    "update_missile_env",
+    "scan_env_for_target_pos",
+    "search_screen_for_target"
+};
+
+// Names of the access priorities, used in the report.
+static const char   *prio_names[ENV_PRIOS] = {
+    "HIGH_ENV_PRIO",
+    "MIDDLE_ENV_PRIO",
+    "LOW_ENV_PRIO"
+};
+
+/********************************************************************
+ * TIMESTAMPS
+********************************************************************/
+
+/*
+ * Get the monotonic clock in nanoseconds.
+ *
+ * ~return: current time in nanoseconds.
+ */
+static uint64_t monotonic_ns()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/*
+ * Read the raw timestamp counter. If the architecture does not provide
+ * one, fallback to the monotonic clock in nanoseconds.
+ *
+ * ~return: current value of the counter.
+ */
+static uint64_t read_counter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return monotonic_ns();
+#endif
+}
+
+/*
+ * Measure the number of nanoseconds for each tick of the counter.
+ */
+static void calibrate_counter()
+{
+    struct timespec t;
+    uint64_t        ns_start, ns_end, c_start, c_end;
+
+    t.tv_sec = 0;
+    t.tv_nsec = PROF_CALIBRATION_NS;
+
+    ns_start = monotonic_ns();
+    c_start = read_counter();
+    nanosleep(&t, NULL);
+    c_end = read_counter();
+    ns_end = monotonic_ns();
+
+    prof.ns_per_tick = c_end > c_start ?
+                       (double)(ns_end - ns_start) / (c_end - c_start) : 1.0;
+}
+
+/*
+ * Convert an interval of counter ticks in nanoseconds.
+ *
+ * t_start: starting timestamp.
+ * t_end: ending timestamp.
+ * ~return: interval in nanoseconds.
+ */
+static uint64_t ticks_to_ns(uint64_t t_start, uint64_t t_end)
+{
+    return t_end > t_start ? (uint64_t)((t_end - t_start) * prof.ns_per_tick)
+                           : 0;
+}
+
+/********************************************************************
+ * RECORDING
+********************************************************************/
+
+/*
+ * Initialize the profiler and calibrate the timestamp counter.
+ */
+void init_profiler(int enabled)
+{
+    prof.enabled = enabled;
+    prof.ns_per_tick = 1.0;
+
+    if (enabled)
+    {
+        calibrate_counter();
+    }
+}
+
+/*
+ * Get a cheap timestamp to measure the environment access.
+ */
+uint64_t prof_now()
+{
+    return prof.enabled ? read_counter() : 0;
+}
+
+/*
+ * Get the logarithmic bucket of a time interval.
+ *
+ * ns: time interval in nanoseconds.
+ * ~return: index of the bucket (floor of log2, 0 for 0 and 1 ns).
+ */
+static int time_bucket(uint64_t ns)
+{
+    int b;
+
+    b = ns > 1 ? 63 - __builtin_clzll(ns) : 0;
+
+    return b < PROF_TIME_BUCKETS ? b : PROF_TIME_BUCKETS - 1;
+}
+
+/*
+ * Atomically update a maximum value.
+ *
+ * max: reference to the current maximum.
+ * value: candidate value.
+ */
+static void update_max(uint64_t *max, uint64_t value)
+{
+    uint64_t    old;
+
+    old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > old &&
+           !__atomic_compare_exchange_n(max, &old, value, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/*
+ * Record an acquisition of the environment.
+ */
+uint64_t prof_env_acquired(int prio, env_caller_t caller,
+                           uint64_t t_req, int depth)
+{
+    prof_entry_t    *e;
+    uint64_t        t_acq, ns;
+
+    if (!prof.enabled)
+    {
+        return 0;
+    }
+
+    t_acq = read_counter();
+    ns = ticks_to_ns(t_req, t_acq);
+    e = &(prof.entry[prio][caller]);
+
+    depth = depth < PROF_DEPTH_BUCKETS ? depth : PROF_DEPTH_BUCKETS - 1;
+
+    __atomic_fetch_add(&e->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->wait_total, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->wait[time_bucket(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->depth[depth], 1, __ATOMIC_RELAXED);
+    update_max(&e->wait_max, ns);
+
+    return t_acq;
+}
+
+/*
+ * Record a release of the environment.
+ */
+void prof_env_released(int prio, env_caller_t caller, uint64_t t_acq)
+{
+    prof_entry_t    *e;
+    uint64_t        ns;
+
+    if (!prof.enabled)
+    {
+        return;
+    }
+
+    ns = ticks_to_ns(t_acq, read_counter());
+    e = &(prof.entry[prio][caller]);
+
+    __atomic_fetch_add(&e->hold_total, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->hold[time_bucket(ns)], 1, __ATOMIC_RELAXED);
+    update_max(&e->hold_max, ns);
+}
+
+/********************************************************************
+ * REPORT
+********************************************************************/
+
+/*
+ * Get the name of a caller of the environment access.
+ */
+char *env_caller_name(env_caller_t caller)
+{
+    return caller_names[caller];
+}
+
+/*
+ * Print a logarithmic time histogram, skipping empty buckets.
+ *
+ * out: stream where the histogram is written.
+ * label: name of the histogram.
+ * hist: buckets of the histogram.
+ * count: total number of samples.
+ */
+static void print_time_hist(FILE *out, char *label, uint64_t *hist,
+                            uint64_t count)
+{
+    int i;
+
+    fprintf(out, "    %s:\n", label);
+    for (i = 0; i < PROF_TIME_BUCKETS; i++)
+    {
+        if (hist[i])
+        {
+            fprintf(out, "      [%12llu, %12llu) ns %10llu %6.2f%%\n",
+                    i ? 1ULL << i : 0ULL, 1ULL << (i + 1),
+                    (unsigned long long)hist[i], 100.0 * hist[i] / count);
+        }
+    }
+}
+
+/*
+ * Print the queue depth histogram, skipping empty buckets.
+ *
+ * out: stream where the histogram is written.
+ * hist: buckets of the histogram.
+ * count: total number of samples.
+ */
+static void print_depth_hist(FILE *out, uint64_t *hist, uint64_t count)
+{
+    int i;
+
+    fprintf(out, "    queue depth:\n");
+    for (i = 0; i < PROF_DEPTH_BUCKETS; i++)
+    {
+        if (hist[i])
+        {
+            fprintf(out, "      %s%-3i %10llu %6.2f%%\n",
+                    i == PROF_DEPTH_BUCKETS - 1 ? ">=" : "  ", i,
+                    (unsigned long long)hist[i], 100.0 * hist[i] / count);
+        }
+    }
+}
+
+/*
+ * Print the histograms of the recorded accesses.
+ */
+void print_profiler_report(FILE *out)
+{
+    prof_entry_t    *e;
+    int             p, c;
+
+    if (!prof.enabled)
+    {
+        return;
+    }
+
+    fprintf(out, "\n===== ENVIRONMENT LOCK PROFILE (%.3f ns/tick) =====\n",
+            prof.ns_per_tick);
+
+    for (p = 0; p < ENV_PRIOS; p++)
+    {
+        for (c = 0; c < ENV_CALLERS; c++)
+        {
+            e = &(prof.entry[p][c]);
+            if (!e->count)
+            {
+                continue;
+            }
+
+            fprintf(out, "%s / %s: %llu accesses\n",
+                    prio_names[p], caller_names[c],
+                    (unsigned long long)e->count);
+            fprintf(out, "    wait avg %llu ns max %llu ns, "
+                         "hold avg %llu ns max %llu ns\n",
+                    (unsigned long long)(e->wait_total / e->count),
+                    (unsigned long long)e->wait_max,
+                    (unsigned long long)(e->hold_total / e->count),
+                    (unsigned long long)e->hold_max);
+
+            print_time_hist(out, "wait", e->wait, e->count);
+            print_time_hist(out, "hold", e->hold, e->count);
+            print_depth_hist(out, e->depth, e->count);
+        }
+    }
+}
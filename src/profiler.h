@@ -0,0 +1,91 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the declarations of the environment lock
+ * contention profiler and the function prototypes necessary to
+ * record and report the measured waiting and holding times.
+ *
+********************************************************************/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "patriots.h"
+
+/********************************************************************
+ * PROFILER PARAMETERS
+********************************************************************/
+
+// Number of logarithmic buckets of the time histograms (2^i ns).
+#define PROF_TIME_BUCKETS   32
+// Number of linear buckets of the queue depth histogram. The last
+// bucket collects every depth greater or equal to its index.
+#define PROF_DEPTH_BUCKETS  (2 * N + 4)
+// Time used to calibrate the timestamp counter (nanoseconds).
+#define PROF_CALIBRATION_NS (50 * 1000 * 1000) // 50 milliseconds
+
+// Callers of the environment access, used to attribute contention.
+typedef enum
+{
+    ENV_CALLER_DRAW,            // Display manager, draw_frame.
+    ENV_CALLER_MISSILE,         // Missile tasks, update_missile_env.
+    ENV_CALLER_TARGET_POS,      // Defender missiles, scan_env_for_target_pos.
+    ENV_CALLER_TARGET_SEARCH,   // Defender launcher, search_screen_for_target.
+    ENV_CALLERS
+}   env_caller_t;
+
+/*
+ * Initialize the profiler and calibrate the timestamp counter.
+ *
+ * enabled: 1 to record the environment accesses, else 0.
+ */
+void init_profiler(int enabled);
+
+/*
+ * Get a cheap timestamp to measure the environment access.
+ *
+ * ~return: current timestamp counter, 0 if the profiler is disabled.
+ */
+uint64_t prof_now();
+
+/*
+ * Record an acquisition of the environment.
+ *
+ * prio: priority used to access the environment.
+ * caller: caller that requested the access.
+ * t_req: timestamp taken before requesting the access.
+ * depth: number of tasks holding or waiting for the environment found
+ * at the moment of the request.
+ * ~return: timestamp of the acquisition, 0 if the profiler is disabled.
+ */
+uint64_t prof_env_acquired(int prio, env_caller_t caller,
+                           uint64_t t_req, int depth);
+
+/*
+ * Record a release of the environment.
+ *
+ * prio: priority used to access the environment.
+ * caller: caller that requested the access.
+ * t_acq: timestamp of the acquisition.
+ */
+void prof_env_released(int prio, env_caller_t caller, uint64_t t_acq);
+
+/*
+ * Get the name of a caller of the environment access.
+ *
+ * caller: caller of the access.
+ * ~return: name of the function accessing the environment.
+ */
+char *env_caller_name(env_caller_t caller);
+
+/*
+ * Print the histograms of the recorded accesses.
+ *
+ * out: stream where the report is written.
+ */
+void print_profiler_report(FILE *out);
+
+#endif
@@ -0,0 +1,191 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the simulation recorder.
+ *
+ * The record file is created with its full size (RECORDER_SIZE) and
+ * mapped in memory at startup, with the pages already loaded, so
+ * appending a record never calls the kernel nor blocks: a task
+ * reserves a slot with an atomic increment and writes the record in
+ * place. The type of the record is written last, so a record with
+ * type REC_NONE was never completed. When the file is full the new
+ * records are dropped and counted.
+ *
+ * At exit the number of records is written in the header and the
+ * file is truncated to the written records; a record left with type
+ * REC_NONE by a task interrupted at exit is skipped by the replay.
+ * The file can be replayed with the replay tool.
+ *
+********************************************************************/
+
+#include "recorder.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "gestor.h"
+#include "calib.h"
+
+// Simulation recorder.
+typedef struct
+{
+    int             enabled;    // Recording flag.
+    int             fd;         // Descriptor of the record file.
+    record_header_t *header;    // Mapped file.
+    record_t        *records;   // Records after the header.
+    uint64_t        capacity;   // Maximum number of records.
+    uint64_t        next;       // Next free record.
+    uint64_t        dropped;    // Records dropped with the file full.
+    struct timespec start;      // Start of the recording.
+}   recorder_t;
+
+static recorder_t   rec;
+
+/********************************************************************
+ * RECORDING
+********************************************************************/
+
+/*
+ * Get the time from the start of the recording.
+ *
+ * ~return: elapsed time in microseconds.
+ */
+static uint32_t rec_time()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (t.tv_sec - rec.start.tv_sec) * 1000000 +
+           (t.tv_nsec - rec.start.tv_nsec) / 1000;
+}
+
+/*
+ * Fill the header of the record file.
+ */
+static void init_header()
+{
+    record_header_t *h;
+
+    h = rec.header;
+    memcpy(h->magic, RECORDER_MAGIC, sizeof(RECORDER_MAGIC));
+    h->version = RECORDER_VERSION;
+    h->rec_size = sizeof(record_t);
+    h->xwin = xwin;
+    h->ywin = ywin;
+    h->missiles = N;
+    h->period = class_period(DISPLAY_TASK);
+    h->count = 0;
+    h->dropped = 0;
+}
+
+/*
+ * Initialize the recorder, creating and mapping the record file.
+ */
+void init_recorder(char *path)
+{
+    void    *map;
+
+    memset(&rec, 0, sizeof(rec));
+
+    if (path == NULL)
+    {
+        return;
+    }
+
+    rec.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (rec.fd < 0 || posix_fallocate(rec.fd, 0, RECORDER_SIZE) != 0)
+    {
+        perror("RECORDER: Unable to create the record file");
+        return;
+    }
+
+    /* Pages loaded now, so the tasks never fault on the file. */
+    map = mmap(NULL, RECORDER_SIZE, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, rec.fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("RECORDER: Unable to map the record file");
+        close(rec.fd);
+        return;
+    }
+
+    rec.header = map;
+    rec.records = (record_t *)(rec.header + 1);
+    rec.capacity = (RECORDER_SIZE - sizeof(record_header_t)) /
+                   sizeof(record_t);
+    init_header();
+
+    clock_gettime(CLOCK_MONOTONIC, &rec.start);
+    rec.enabled = 1;
+}
+
+/*
+ * Append a record to the file. Never blocks: if the file is full
+ * the record is dropped.
+ */
+void record(record_type_t type, int kind, int index, int x, int y, int value)
+{
+    record_t    *r;
+    uint64_t    i;
+
+    if (!rec.enabled)
+    {
+        return;
+    }
+
+    i = __atomic_fetch_add(&rec.next, 1, __ATOMIC_RELAXED);
+    if (i >= rec.capacity)
+    {
+        __atomic_fetch_add(&rec.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    r = &(rec.records[i]);
+    r->time = rec_time();
+    r->kind = kind;
+    r->index = index;
+    r->x = x;
+    r->y = y;
+    r->value = value;
+
+    /* Type written last: marks the record as complete. */
+    __atomic_store_n(&r->type, type, __ATOMIC_RELEASE);
+}
+
+/*
+ * Close the record file, truncating it to the written records.
+ */
+void flush_recorder()
+{
+    uint64_t    count;
+
+    if (!rec.enabled)
+    {
+        return;
+    }
+
+    rec.enabled = 0;
+
+    /* Tasks still running find the file full from now on. */
+    count = __atomic_exchange_n(&rec.next, rec.capacity, __ATOMIC_RELAXED);
+    count = count < rec.capacity ? count : rec.capacity;
+    rec.header->count = count;
+    rec.header->dropped = rec.dropped;
+
+    /* The file stays mapped: the tasks may be completing a record. */
+    msync(rec.header, RECORDER_SIZE, MS_SYNC);
+
+    if (ftruncate(rec.fd, sizeof(record_header_t) +
+                          count * sizeof(record_t)) != 0)
+    {
+        perror("RECORDER: Unable to truncate the record file");
+    }
+    close(rec.fd);
+
+    fprintf(stderr, "\n===== RECORDER =====\n"
+                    "%llu records written, %llu dropped (file full)\n",
+            (unsigned long long)count, (unsigned long long)rec.dropped);
+}
@@ -0,0 +1,93 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the declarations of the simulation recorder,
+ * the format of the record files and the function prototypes
+ * necessary to append the records and close the file.
+ *
+********************************************************************/
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+
+#include "patriots.h"
+
+/********************************************************************
+ * RECORDER PARAMETERS
+********************************************************************/
+
+// Size of the preallocated record file (header included).
+#define RECORDER_SIZE       (64 * 1024 * 1024) // 64 MiB
+// Magic string at the start of a record file.
+#define RECORDER_MAGIC      "PATRREC"
+// Version of the record file format.
+#define RECORDER_VERSION    1
+
+// Types of the records.
+typedef enum
+{
+    REC_NONE,           // Never written: marks the end of a truncated file.
+    REC_TICK,           // Display frame: value is the frame number.
+    REC_POSITION,       // Missile moved to (x, y): value is its target.
+    REC_SPAWN,          // Missile started at (x, y): value is speed * 1000.
+    REC_DEATH,          // Missile removed.
+    REC_ASSIGN,         // Attacker at (x, y) assigned to defender value.
+    REC_COLLISION,      // Missile collided at (x, y) with a cell of type value.
+    REC_SCORE,          // New score: x attacker points, y defender points.
+    REC_DEADLINE_MISS,  // Deadline miss of the task with index value.
+    REC_TYPES
+}   record_type_t;
+
+// Single record of the file.
+typedef struct
+{
+    uint32_t    time;       // Time from the start of the recording (us).
+    uint8_t     type;       // Type of the record (record_type_t).
+    uint8_t     kind;       // Missile type (missile_type_t), if any.
+    int16_t     index;      // Missile index, if any.
+    int16_t     x, y;       // Position or values, depending on type.
+    int32_t     value;      // Value, depending on type.
+}   record_t;
+
+// Header of the record file, followed by the records.
+typedef struct
+{
+    char        magic[8];   // RECORDER_MAGIC.
+    uint32_t    version;    // RECORDER_VERSION.
+    uint32_t    rec_size;   // Size of a single record.
+    uint32_t    xwin, ywin; // Size of the environment.
+    uint32_t    missiles;   // Number of missiles for each type (N).
+    uint32_t    period;     // Period of the display (ms).
+    uint64_t    count;      // Number of records, 0 if not closed.
+    uint64_t    dropped;    // Records dropped with the file full.
+}   record_header_t;
+
+/*
+ * Initialize the recorder, creating and mapping the record file.
+ * Must be called by the main thread.
+ *
+ * path: file where the records are written, NULL to disable.
+ */
+void init_recorder(char *path);
+
+/*
+ * Append a record to the file. Never blocks: if the file is full
+ * the record is dropped.
+ *
+ * type: type of the record.
+ * kind: missile type, or 0.
+ * index: missile index, or 0.
+ * x: horizontal position or value, depending on type.
+ * y: vertical position or value, depending on type.
+ * value: value, depending on type.
+ */
+void record(record_type_t type, int kind, int index, int x, int y, int value);
+
+/*
+ * Close the record file, truncating it to the written records.
+ */
+void flush_recorder();
+
+#endif
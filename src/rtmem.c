@@ -0,0 +1,170 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the real-time memory setup.
+ *
+ * The memory of the process is locked at the start of the system,
+ * before the environment and the bitmaps are allocated and touched:
+ * the current pages (text, data, libraries) are faulted in and locked
+ * at once, the startup faults the others the tasks use. The future
+ * pages are locked only when touched (MCL_ONFAULT, if available), in a
+ * separate call that leaves the current ones faulted in: every thread
+ * stack would otherwise be faulted whole when the thread is created.
+ * The stack of every task is instead prefaulted for RT_STACK_PREFAULT
+ * bytes at its start, before its first period.
+ *
+ * With RT_ALLOC_GUARD (make DEBUG=1) malloc, calloc and realloc are
+ * wrapped: every allocation made by a real-time task is counted, with
+ * the caller of the first one, and printed when the system ends.
+ *
+********************************************************************/
+
+#include "rtmem.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Real-time memory state.
+typedef struct
+{
+    int         locked;         // 1 if the memory is locked.
+    uint64_t    allocs;         // Allocations of the real-time tasks.
+    void        *first_caller;  // Caller of the first allocation.
+}   rtmem_t;
+
+static rtmem_t          rtmem;
+
+// 1 in the real-time tasks, after their start.
+static __thread int     rt_task;
+// Nesting of the allowed allocations of the current task.
+static __thread int     rt_allowed;
+
+/*
+ * Lock the current and the future memory of the process.
+ */
+void init_rtmem()
+{
+    int flags;
+
+    /* Alone: with MCL_ONFAULT the missing pages would not be faulted. */
+    if (mlockall(MCL_CURRENT) != 0)
+    {
+        perror("RTMEM: Unable to lock the memory");
+        return;
+    }
+
+    /* Without MCL_CURRENT the pages locked above stay locked. */
+    flags = MCL_FUTURE;
+#ifdef MCL_ONFAULT
+    flags |= MCL_ONFAULT;
+#endif
+
+    if (mlockall(flags) != 0)
+    {
+        perror("RTMEM: Unable to lock the future memory");
+        return;
+    }
+
+    rtmem.locked = 1;
+}
+
+/*
+ * Touch the first RT_STACK_PREFAULT bytes of stack under the caller.
+ * Never inlined, so the array is below the frame of the caller.
+ */
+static void __attribute__((noinline)) prefault_stack()
+{
+    char    stack[RT_STACK_PREFAULT];
+
+    memset(stack, 0, sizeof(stack));
+
+    /* The array is never read: keep the writes anyway. */
+    __asm__ volatile("" : : "r"(stack) : "memory");
+}
+
+/*
+ * Prefault the stack of the current task and mark it as a real-time
+ * task.
+ */
+void rt_task_start()
+{
+    prefault_stack();
+    rt_task = 1;
+}
+
+/*
+ * Allow the allocations of the current task.
+ */
+void rt_alloc_begin()
+{
+    rt_allowed++;
+}
+
+/*
+ * End the allowed allocations of the current task.
+ */
+void rt_alloc_end()
+{
+    rt_allowed--;
+}
+
+#ifdef RT_ALLOC_GUARD
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+/*
+ * Count an allocation if made by a real-time task.
+ *
+ * caller: return address of the allocation.
+ */
+static void check_alloc(void *caller)
+{
+    if (rt_task && !rt_allowed)
+    {
+        if (__atomic_fetch_add(&rtmem.allocs, 1, __ATOMIC_RELAXED) == 0)
+        {
+            rtmem.first_caller = caller;
+        }
+    }
+}
+
+void *malloc(size_t size)
+{
+    check_alloc(__builtin_return_address(0));
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    check_alloc(__builtin_return_address(0));
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    check_alloc(__builtin_return_address(0));
+    return __libc_realloc(ptr, size);
+}
+
+#endif
+
+/*
+ * Print the allocations made by the real-time tasks.
+ */
+void print_rtmem_report(FILE *out)
+{
+#ifdef RT_ALLOC_GUARD
+    fprintf(out, "\n===== REAL-TIME MEMORY =====\n"
+                 "memory locked: %s\n"
+                 "allocations in real-time tasks: %llu",
+            rtmem.locked ? "yes" : "no", (unsigned long long)rtmem.allocs);
+    if (rtmem.allocs)
+    {
+        fprintf(out, " (first from %p)", rtmem.first_caller);
+    }
+    fprintf(out, "\n");
+#endif
+}
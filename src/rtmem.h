@@ -0,0 +1,50 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the parameters of the real-time memory setup
+ * and the function prototypes necessary to lock the memory, prefault
+ * the stacks of the tasks and check that the tasks do not allocate.
+ *
+********************************************************************/
+
+#ifndef RTMEM_H
+#define RTMEM_H
+
+#include <stdio.h>
+
+// Bytes of stack prefaulted by every task at its start.
+#define RT_STACK_PREFAULT   (64 * 1024)
+
+/*
+ * Lock the current and the future memory of the process, so that the
+ * pages touched during the startup are never paged out. Must be called
+ * by the main thread, before any allocation of the startup.
+ */
+void init_rtmem();
+
+/*
+ * Prefault the stack of the current task and mark it as a real-time
+ * task for the allocation guard.
+ */
+void rt_task_start();
+
+/*
+ * Allow the allocations of the current task until rt_alloc_end, for
+ * the operations that allocate by design (creation of a task).
+ */
+void rt_alloc_begin();
+
+/*
+ * End the allocations allowed by rt_alloc_begin.
+ */
+void rt_alloc_end();
+
+/*
+ * Print the allocations made by the real-time tasks, if the allocation
+ * guard is compiled (RT_ALLOC_GUARD).
+ *
+ * out: stream where the report is written.
+ */
+void print_rtmem_report(FILE *out);
+
+#endif
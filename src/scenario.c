@@ -0,0 +1,353 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the attack scenarios loader and task.
+ *
+ * A scenario is a text file with one directive per line (empty
+ * lines and lines starting with '#' are ignored):
+ *
+ *   seed <n>
+ *   wave <start> <count> <interval> <x> <speed> <angle>
+ *   repeat <period>
+ *
+ * Every wave launches <count> attacker missiles, the first one at
+ * <start> milliseconds from the start of the scenario and the others
+ * every <interval> milliseconds. The starting parameters <x>, <speed>
+ * and <angle> can be a number, a range "min:max" sampled uniformly,
+ * or "*" for the same range used by the keyboard launches. The
+ * explicit values are checked: <x> inside the walls, <speed> positive
+ * and <angle> within the band of the keyboard launches, so a missile
+ * always starts in the environment and leaves the top wall.
+ * With "repeat" the whole scenario restarts every <period>
+ * milliseconds, otherwise the loader ends after the last launch.
+ *
+ * The random values are generated from the seed of the scenario
+ * with a private generator, so a scenario produces always the same
+ * sequence of missiles.
+ *
+********************************************************************/
+
+#include "scenario.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "ptask.h"
+#include "launchers.h"
+#include "gestor.h"
+
+// Range of values for a starting parameter.
+typedef struct
+{
+    float   min, max;
+}   range_t;
+
+// Single wave of attacker missiles.
+typedef struct
+{
+    long    start;          // Time of the first launch (ms).
+    int     count;          // Number of missiles.
+    long    interval;       // Time between launches (ms).
+    range_t x;              // Horizontal starting point.
+    range_t speed;          // Speed of the missiles.
+    range_t angle;          // Angle of the trajectories.
+}   wave_t;
+
+// Scenario loaded from file.
+typedef struct
+{
+    int             loaded;                     // 1 if a file was loaded.
+    unsigned int    seed;                       // Seed of the generator.
+    long            repeat;                     // Repeat period, or 0.
+    int             nwaves;                     // Number of waves.
+    wave_t          waves[SCENARIO_MAX_WAVES];  // Waves of the scenario.
+    long            injected;                   // Accepted requests.
+    long            dropped;                    // Requests with full queue.
+}   scenario_t;
+
+static scenario_t   scenario;
+
+/********************************************************************
+ * PARSING
+********************************************************************/
+
+/*
+ * Parse a starting parameter.
+ *
+ * s: string to parse ("value", "min:max" or "*").
+ * dfl_min: lower bound of the default range.
+ * dfl_max: upper bound of the default range.
+ * r: reference to the parsed range.
+ * ~return: 1 if the string is valid, else 0.
+ */
+static int parse_range(char *s, float dfl_min, float dfl_max, range_t *r)
+{
+    int ret;
+
+    ret = 1;
+
+    if (strcmp(s, "*") == 0)
+    {
+        r->min = dfl_min;
+        r->max = dfl_max;
+    }
+    else if (sscanf(s, "%f:%f", &r->min, &r->max) != 2)
+    {
+        ret = sscanf(s, "%f", &r->min) == 1;
+        r->max = r->min;
+    }
+
+    return ret && r->min <= r->max;
+}
+
+/*
+ * Parse a wave directive, checking the starting parameters.
+ *
+ * line: line of the scenario file after the directive name.
+ * w: reference to the parsed wave.
+ * ~return: 1 if the line is valid, else 0.
+ */
+static int parse_wave(char *line, wave_t *w)
+{
+    char    x[SCENARIO_LINE_LEN], speed[SCENARIO_LINE_LEN];
+    char    angle[SCENARIO_LINE_LEN];
+    float   min_x, max_x;
+
+    if (sscanf(line, "%li %i %li %s %s %s", &w->start, &w->count,
+               &w->interval, x, speed, angle) != 6)
+    {
+        return 0;
+    }
+
+    /* The start cell of a missile must be inside the walls. */
+    min_x = WALL_THICKNESS + MISSILE_RADIUS + 1;
+    max_x = xwin - WALL_THICKNESS - MISSILE_RADIUS - 1;
+
+    return w->start >= 0 && w->count > 0 && w->interval >= 0 &&
+           parse_range(x, min_x, max_x, &w->x) &&
+           w->x.min >= min_x && w->x.max <= max_x &&
+           parse_range(speed, MIN_ATK_SPEED, MAX_ATK_SPEED, &w->speed) &&
+           w->speed.min > 0 &&
+           parse_range(angle, MAX_ATK_ANGLE, 180 - MAX_ATK_ANGLE, &w->angle) &&
+           w->angle.min >= MAX_ATK_ANGLE &&
+           w->angle.max <= 180 - MAX_ATK_ANGLE;
+}
+
+/*
+ * Parse a single line of the scenario file.
+ *
+ * line: line to parse.
+ * ~return: 1 if the line is valid, else 0.
+ */
+static int parse_line(char *line)
+{
+    char    directive[SCENARIO_LINE_LEN];
+    int     offset, ret;
+
+    if (sscanf(line, "%s%n", directive, &offset) != 1 || directive[0] == '#')
+    {
+        return 1;   // Empty line or comment.
+    }
+
+    line += offset;
+    ret = 0;
+
+    if (strcmp(directive, "seed") == 0)
+    {
+        ret = sscanf(line, "%u", &scenario.seed) == 1;
+    }
+    else if (strcmp(directive, "repeat") == 0)
+    {
+        ret = sscanf(line, "%li", &scenario.repeat) == 1 &&
+              scenario.repeat > 0;
+    }
+    else if (strcmp(directive, "wave") == 0 &&
+             scenario.nwaves < SCENARIO_MAX_WAVES)
+    {
+        ret = parse_wave(line, &scenario.waves[scenario.nwaves]);
+        scenario.nwaves += ret;
+    }
+
+    return ret;
+}
+
+/*
+ * Load a scenario file.
+ */
+int load_scenario(char *path)
+{
+    FILE    *f;
+    char    line[SCENARIO_LINE_LEN];
+    int     n, ret;
+
+    memset(&scenario, 0, sizeof(scenario));
+
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror("SCENARIO: Unable to open the scenario file");
+        return 0;
+    }
+
+    ret = 1;
+    for (n = 1; ret && fgets(line, SCENARIO_LINE_LEN, f) != NULL; n++)
+    {
+        ret = parse_line(line);
+        if (!ret)
+        {
+            fprintf(stderr, "SCENARIO: Invalid line %i: %s", n, line);
+        }
+    }
+
+    fclose(f);
+
+    scenario.loaded = ret && scenario.nwaves > 0;
+
+    return scenario.loaded;
+}
+
+/********************************************************************
+ * SCENARIO TASK
+********************************************************************/
+
+/*
+ * Sample a starting parameter with the private generator.
+ *
+ * r: reference to the range of the parameter.
+ * state: state of the generator.
+ * ~return: sampled value.
+ */
+static float sample(range_t *r, unsigned int *state)
+{
+    return r->min + (r->max - r->min) * (rand_r(state) / (float)RAND_MAX);
+}
+
+/*
+ * Request the launch of a missile of a wave.
+ *
+ * w: reference to the wave.
+ * state: state of the generator.
+ */
+static void inject(wave_t *w, unsigned int *state)
+{
+    atk_spec_t  spec;
+
+    spec.x = sample(&w->x, state);
+    spec.speed = sample(&w->speed, state);
+    spec.angle = sample(&w->angle, state);
+
+    if (request_atk_launch_spec(&spec))
+    {
+        scenario.injected++;
+    }
+    else
+    {
+        scenario.dropped++;
+    }
+}
+
+/*
+ * Inject all the launches of the scenario due in the interval of time
+ * (from, to], relative to the start of the current repetition.
+ *
+ * from: end of the previous interval (ms), -1 at the start.
+ * to: current time (ms).
+ * state: state of the generator.
+ * ~return: 1 if there are launches after the interval, else 0.
+ */
+static int inject_due(long from, long to, unsigned int *state)
+{
+    wave_t  *w;
+    long    t;
+    int     i, k, pending;
+
+    pending = 0;
+
+    for (i = 0; i < scenario.nwaves; i++)
+    {
+        w = &(scenario.waves[i]);
+        for (k = 0; k < w->count; k++)
+        {
+            t = w->start + k * w->interval;
+            if (t > from && t <= to)
+            {
+                inject(w, state);
+            }
+            pending |= t > to;
+        }
+    }
+
+    return pending;
+}
+
+/*
+ * Scenario loader task: injects the launches of the waves when due.
+ */
+static ptask scenario_loader()
+{
+    unsigned int    state;
+    long            start, last, now;
+    int             pending;
+
+    task_start(SCENARIO_TASK);
+
+    state = scenario.seed;
+    start = ptask_gettime(MILLI);
+    last = -1;
+
+    do
+    {
+        now = ptask_gettime(MILLI) - start;
+        pending = inject_due(last, now, &state);
+        last = now;
+
+        /* Restart the scenario at the end of the repeat period. */
+        if (scenario.repeat && now >= scenario.repeat)
+        {
+            start += scenario.repeat;
+            last = -1;
+            pending = 1;
+        }
+
+        task_wait_for_period();
+    } while ((pending || scenario.repeat) && !end);
+
+    fprintf(stderr, "SCENARIO: Completed\n");
+
+    task_end();
+}
+
+/*
+ * Launch the scenario loader task, if a scenario was loaded.
+ */
+void launch_scenario_loader()
+{
+    int task;
+
+    if (!scenario.loaded)
+    {
+        return;
+    }
+
+    task = ptask_create_prio(scenario_loader,
+                             SCENARIO_PERIOD,
+                             SCENARIO_PRIO,
+                             NOW);
+
+    assert(task >= 0);
+
+    fprintf(stderr, "Created SCENARIO loader with %i waves\n",
+            scenario.nwaves);
+}
+
+/*
+ * Print the number of injected and dropped attacker missiles.
+ */
+void print_scenario_report(FILE *out)
+{
+    if (scenario.loaded)
+    {
+        fprintf(out, "\n===== SCENARIO =====\n"
+                     "injected %li, dropped %li (queue full)\n",
+                scenario.injected, scenario.dropped);
+    }
+}
@@ -0,0 +1,50 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the declarations of the attack scenarios and
+ * the function prototypes necessary to load a scenario file and
+ * launch the task that injects its waves of attacker missiles.
+ *
+********************************************************************/
+
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <stdio.h>
+
+#include "patriots.h"
+
+/********************************************************************
+ * SCENARIO PARAMETERS
+********************************************************************/
+
+// Maximum number of waves in a scenario.
+#define SCENARIO_MAX_WAVES      64
+// Maximum length of a line of the scenario file.
+#define SCENARIO_LINE_LEN       256
+// Period of the scenario loader task.
+#define SCENARIO_PERIOD         5
+// Priority of the scenario loader task.
+#define SCENARIO_PRIO           1
+
+/*
+ * Load a scenario file.
+ *
+ * path: path of the scenario file.
+ * ~return: 1 if the scenario was loaded, else 0.
+ */
+int load_scenario(char *path);
+
+/*
+ * Launch the scenario loader task, if a scenario was loaded.
+ */
+void launch_scenario_loader();
+
+/*
+ * Print the number of injected and dropped attacker missiles.
+ *
+ * out: stream where the report is written.
+ */
+void print_scenario_report(FILE *out);
+
+#endif
@@ -0,0 +1,313 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the export of the state of the system in a
+ * POSIX shared memory segment, read by external monitors.
+ *
+ * The segment is created and mapped at startup. The world (scores
+ * and missiles) is written only by the display manager, from the copy
+ * of the environment taken for the frame, so the missiles are
+ * published as the environment held them, never while a missile task
+ * is moving them. The slot of
+ * a task only by the task itself, so every part has a single writer
+ * and is protected by a sequence lock: the writer makes the sequence
+ * odd before writing and even again after. A reader copies the part
+ * and retries if the sequence was odd or changed during the copy.
+ * Publishing never calls the kernel nor waits for the readers.
+ *
+********************************************************************/
+
+#include "shmexport.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "launchers.h"
+
+// Shared memory export.
+typedef struct
+{
+    int         enabled;    // Publishing flag.
+    shm_state_t *state;     // Mapped segment.
+}   shmexport_t;
+
+static shmexport_t          shm;
+
+// Slot of the current task, or NULL.
+static __thread shm_task_t  *own;
+// Start of the current job of the task (ns).
+static __thread uint64_t    job_start;
+
+/********************************************************************
+ * SEQUENCE LOCK
+********************************************************************/
+
+/*
+ * Start writing a part protected by a sequence lock.
+ *
+ * seq: reference to the sequence of the part.
+ */
+static void seq_write_begin(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/*
+ * End writing a part protected by a sequence lock.
+ *
+ * seq: reference to the sequence of the part.
+ */
+static void seq_write_end(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Get the monotonic clock in nanoseconds.
+ *
+ * ~return: current time in nanoseconds.
+ */
+static uint64_t shm_now()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/********************************************************************
+ * SEGMENT
+********************************************************************/
+
+/*
+ * Initialize the shared memory export, creating and mapping the
+ * segment.
+ */
+void init_shmexport(int enabled)
+{
+    void    *map;
+    int     fd;
+
+    memset(&shm, 0, sizeof(shm));
+
+    if (!enabled)
+    {
+        return;
+    }
+
+    fd = shm_open(SHM_NAME, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(shm_state_t)) != 0)
+    {
+        perror("SHMEXPORT: Unable to create the shared memory");
+        return;
+    }
+
+    map = mmap(NULL, sizeof(shm_state_t), PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("SHMEXPORT: Unable to map the shared memory");
+        shm_unlink(SHM_NAME);
+        return;
+    }
+
+    shm.state = map;
+    memset(shm.state, 0, sizeof(shm_state_t));
+    shm.state->version = SHM_VERSION;
+    shm.state->size = sizeof(shm_state_t);
+    shm.state->missiles = N;
+    shm.state->tasks = SHM_TASKS;
+    shm.state->running = 1;
+
+    /* Magic written last: readers check it before using the segment. */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(shm.state->magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+
+    shm.enabled = 1;
+}
+
+/*
+ * Mark the system as ended and remove the segment name.
+ */
+void close_shmexport()
+{
+    if (!shm.enabled)
+    {
+        return;
+    }
+
+    /* The segment stays mapped: the tasks may still be publishing. */
+    __atomic_store_n(&shm.state->running, 0, __ATOMIC_RELEASE);
+    shm_unlink(SHM_NAME);
+}
+
+/********************************************************************
+ * TASKS
+********************************************************************/
+
+/*
+ * Publish the start of the current task.
+ */
+void shm_task_start(char *name)
+{
+    int i;
+
+    own = NULL;
+    i = ptask_get_index();
+
+    if (!shm.enabled || i < 0 || i >= SHM_TASKS)
+    {
+        return;
+    }
+
+    own = &(shm.state->task[i]);
+
+    /* Task indexes are reused: the slot starts again from zero. */
+    seq_write_begin(&own->seq);
+    own->active = 1;
+    strncpy(own->name, name, SHM_NAME_LEN - 1);
+    own->name[SHM_NAME_LEN - 1] = '\0';
+    own->jobs = own->dmiss = 0;
+    own->last_ns = own->max_ns = 0;
+    seq_write_end(&own->seq);
+
+    job_start = shm_now();
+}
+
+/*
+ * Publish the start of a job of the current task.
+ */
+void shm_job_start()
+{
+    if (own != NULL)
+    {
+        job_start = shm_now();
+    }
+}
+
+/*
+ * Publish the end of a job of the current task.
+ */
+void shm_job_end()
+{
+    uint64_t    t;
+
+    if (own == NULL)
+    {
+        return;
+    }
+
+    t = shm_now() - job_start;
+
+    seq_write_begin(&own->seq);
+    own->jobs++;
+    own->last_ns = t;
+    own->max_ns = t > own->max_ns ? t : own->max_ns;
+    seq_write_end(&own->seq);
+}
+
+/*
+ * Publish a deadline miss of the current task.
+ */
+void shm_deadline_miss()
+{
+    if (own == NULL)
+    {
+        return;
+    }
+
+    seq_write_begin(&own->seq);
+    own->dmiss++;
+    seq_write_end(&own->seq);
+}
+
+/*
+ * Publish the end of the current task.
+ */
+void shm_task_end()
+{
+    if (own == NULL)
+    {
+        return;
+    }
+
+    shm_job_end();
+
+    seq_write_begin(&own->seq);
+    own->active = 0;
+    seq_write_end(&own->seq);
+
+    own = NULL;
+}
+
+/********************************************************************
+ * WORLD
+********************************************************************/
+
+/*
+ * Start publishing the world: scores, missiles inactive.
+ */
+void shm_world_begin(int atk_points, int def_points)
+{
+    shm_world_t *w;
+    int         i;
+
+    if (!shm.enabled)
+    {
+        return;
+    }
+
+    w = &(shm.state->world);
+
+    seq_write_begin(&shm.state->seq);
+
+    w->frame++;
+    w->time_ns = shm_now();
+    w->atk_points = atk_points;
+    w->def_points = def_points;
+
+    for (i = 0; i < N; i++)
+    {
+        w->atk[i].active = w->def[i].active = 0;
+    }
+}
+
+/*
+ * Publish an active missile of the world.
+ */
+void shm_world_missile(int type, int index, int x, int y, int target,
+                       float speed, float angle)
+{
+    shm_missile_t   *m;
+
+    if (!shm.enabled)
+    {
+        return;
+    }
+
+    m = type == ATTACKER ? &(shm.state->world.atk[index])
+                         : &(shm.state->world.def[index]);
+
+    m->active = 1;
+    m->x = x;
+    m->y = y;
+    m->target = target;
+    m->speed = speed;
+    m->angle = angle;
+}
+
+/*
+ * End publishing the world.
+ */
+void shm_world_end()
+{
+    if (shm.enabled)
+    {
+        seq_write_end(&shm.state->seq);
+    }
+}
@@ -0,0 +1,151 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the layout of the shared memory segment where
+ * the state of the system is published for external monitors, and
+ * the function prototypes necessary to publish it.
+ *
+********************************************************************/
+
+#ifndef SHMEXPORT_H
+#define SHMEXPORT_H
+
+#include <stdint.h>
+
+#include "patriots.h"
+#include "ptask.h"
+
+/********************************************************************
+ * SHARED MEMORY PARAMETERS
+********************************************************************/
+
+// Name of the POSIX shared memory segment.
+#define SHM_NAME            "/patriots"
+// Magic string at the start of the segment.
+#define SHM_MAGIC           "PATRSHM"
+// Version of the layout of the segment.
+#define SHM_VERSION         1
+// Number of task slots (one for each ptask index).
+#define SHM_TASKS           MAX_TASKS
+// Maximum length of the name of a task class.
+#define SHM_NAME_LEN        16
+// Size of a cache line, used to align the slots written by the tasks.
+#define SHM_LINE            64
+
+// Published state of a missile.
+typedef struct
+{
+    int32_t     active;     // 1 if the missile is flying.
+    int32_t     x, y;       // Position.
+    int32_t     target;     // Assigned target, or NONE.
+    float       speed;      // Speed.
+    float       angle;      // Angle of the trajectory.
+}   shm_missile_t;
+
+// Published world, written by the display manager once for each frame.
+typedef struct
+{
+    uint64_t        frame;                  // Number of the frame.
+    uint64_t        time_ns;                // Time of the frame.
+    int32_t         atk_points, def_points; // Current score.
+    shm_missile_t   atk[N];                 // Attacker missiles.
+    shm_missile_t   def[N];                 // Defender missiles.
+}   shm_world_t;
+
+// Published statistics of a task, written only by the task itself.
+typedef struct
+{
+    uint32_t    seq;                    // Sequence lock of the slot.
+    int32_t     active;                 // 1 if the task is running.
+    char        name[SHM_NAME_LEN];     // Name of the task class.
+    uint64_t    jobs;                   // Completed jobs.
+    uint64_t    dmiss;                  // Deadline misses.
+    uint64_t    last_ns;                // Duration of the last job.
+    uint64_t    max_ns;                 // Maximum duration of a job.
+}   __attribute__((aligned(SHM_LINE))) shm_task_t;
+
+// Layout of the shared memory segment.
+typedef struct
+{
+    char            magic[8];               // SHM_MAGIC.
+    uint32_t        version;                // SHM_VERSION.
+    uint32_t        size;                   // Size of the segment.
+    uint32_t        missiles;               // Missiles for each type (N).
+    uint32_t        tasks;                  // Number of task slots.
+    int32_t         running;                // 0 when the system ended.
+    uint32_t        seq __attribute__((aligned(SHM_LINE))); // World lock.
+    shm_world_t     world;                  // Scores and missiles.
+    shm_task_t      task[SHM_TASKS];        // Tasks statistics.
+}   shm_state_t;
+
+/*
+ * Initialize the shared memory export, creating and mapping the
+ * segment. Must be called by the main thread.
+ *
+ * enabled: 1 to publish the state, else 0.
+ */
+void init_shmexport(int enabled);
+
+/*
+ * Publish the start of the current task.
+ *
+ * name: name of the task class.
+ */
+void shm_task_start(char *name);
+
+/*
+ * Publish the start of a job of the current task.
+ */
+void shm_job_start();
+
+/*
+ * Publish the end of a job of the current task.
+ */
+void shm_job_end();
+
+/*
+ * Publish a deadline miss of the current task.
+ */
+void shm_deadline_miss();
+
+/*
+ * Publish the end of the current task.
+ */
+void shm_task_end();
+
+/*
+ * Start publishing the world: the scores, every missile inactive until
+ * published by shm_world_missile. Must be called only by the display
+ * manager, followed by shm_world_end.
+ *
+ * atk_points: attacker points.
+ * def_points: defender points.
+ */
+void shm_world_begin(int atk_points, int def_points);
+
+/*
+ * Publish an active missile of the world.
+ *
+ * type: type of the missile (missile_type_t).
+ * index: index of the missile.
+ * x: horizontal coordinate of the missile.
+ * y: vertical coordinate of the missile.
+ * target: assigned target, or NONE.
+ * speed: speed of the missile.
+ * angle: angle of the trajectory.
+ */
+void shm_world_missile(int type, int index, int x, int y, int target,
+                       float speed, float angle);
+
+/*
+ * End publishing the world.
+ */
+void shm_world_end();
+
+/*
+ * Mark the system as ended and remove the segment name. Monitors that
+ * already mapped the segment keep the last state.
+ */
+void close_shmexport();
+
+#endif
@@ -0,0 +1,443 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the task tracer.
+ *
+ * Every task records its events in a private buffer, selected by
+ * the index of the task, so no synchronization is needed while
+ * recording. The main thread uses an additional buffer. The buffers
+ * are circular: when a buffer is full the oldest events are
+ * overwritten, so the trace always contains the last part of the
+ * execution.
+ *
+ * At exit the buffers are written in the Chrome trace-event JSON
+ * format, which can be opened with chrome://tracing or Perfetto.
+ *
+ * The same events can also be written as compact markers on the
+ * ftrace trace_marker file, opened once at startup, in order to
+ * correlate them with the kernel scheduling events. If tracefs is
+ * not available the markers are silently disabled.
+ *
+********************************************************************/
+
+#include "tracer.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ptask.h"
+
+// Number of event buffers: one for each task and one for the main.
+#define TRACE_SLOTS         (MAX_TASKS + 1)
+// Buffer used by the main thread.
+#define TRACE_MAIN_SLOT     MAX_TASKS
+// Maximum length of a single ftrace marker.
+#define MARKER_LEN          64
+
+// Single trace event.
+typedef struct
+{
+    uint64_t    ts;     // Timestamp from the start of the trace (ns).
+    char        *name;  // Name of the event (static string).
+    char        phase;  // Chrome phase: 'B' begin, 'E' end, 'i' instant.
+    int         arg;    // Numeric argument of instant events.
+}   trace_event_t;
+
+// Event buffer of a single task.
+typedef struct
+{
+    trace_event_t   *events;                // Circular buffer of events.
+    uint64_t        count;                  // Total number of events.
+    char            *job;                   // Name of the current job.
+    char            name[TRACE_NAME_LEN];   // Name of the last task class.
+}   trace_slot_t;
+
+// Tracer of the tasks.
+typedef struct
+{
+    int             enabled;                // Recording flag.
+    int             marker_fd;              // ftrace marker file or NONE.
+    char            *path;                  // Output file.
+    struct timespec start;                  // Reference time.
+    trace_slot_t    slot[TRACE_SLOTS];      // Buffers for each task.
+}   tracer_t;
+
+static tracer_t     tracer;
+
+// Buffer of the current thread if it is not a ptask (the main).
+static __thread int own_slot = NONE;
+
+/********************************************************************
+ * INITIALIZATION
+********************************************************************/
+
+// Possible locations of the ftrace marker file.
+static char         *marker_paths[] = {
+    "/sys/kernel/tracing/trace_marker",
+    "/sys/kernel/debug/tracing/trace_marker"
+};
+
+/*
+ * Open the ftrace marker file, trying every known location of tracefs.
+ *
+ * ~return: file descriptor of the marker file, NONE if not available.
+ */
+static int open_marker()
+{
+    int fd, i, n;
+
+    fd = NONE;
+    n = sizeof(marker_paths) / sizeof(marker_paths[0]);
+
+    for (i = 0; fd < 0 && i < n; i++)
+    {
+        fd = open(marker_paths[i], O_WRONLY | O_CLOEXEC);
+    }
+
+    return fd >= 0 ? fd : NONE;
+}
+
+/*
+ * Initialize the tracer. Must be called by the main thread.
+ */
+void init_tracer(char *path, int markers)
+{
+    int i;
+
+    tracer.enabled = 0;
+    tracer.path = path;
+    tracer.marker_fd = markers ? open_marker() : NONE;
+
+    own_slot = TRACE_MAIN_SLOT;
+    strcpy(tracer.slot[TRACE_MAIN_SLOT].name, "main");
+
+    if (path == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < TRACE_SLOTS; i++)
+    {
+        tracer.slot[i].events = calloc(TRACE_EVENTS, sizeof(trace_event_t));
+        if (tracer.slot[i].events == NULL)
+        {
+            fprintf(stderr, "TRACER: Unable to allocate the buffers\n");
+            return;
+        }
+        tracer.slot[i].count = 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &tracer.start);
+    tracer.enabled = 1;
+}
+
+/********************************************************************
+ * RECORDING
+********************************************************************/
+
+/*
+ * Get the buffer of the current thread.
+ *
+ * ~return: reference to the buffer.
+ */
+static trace_slot_t *current_slot()
+{
+    return &(tracer.slot[own_slot != NONE ? own_slot : ptask_get_index()]);
+}
+
+/*
+ * Get the time elapsed from the start of the trace.
+ *
+ * ~return: elapsed time in nanoseconds.
+ */
+static uint64_t trace_time()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)(t.tv_sec - tracer.start.tv_sec) * 1000000000ULL +
+           t.tv_nsec - tracer.start.tv_nsec;
+}
+
+/*
+ * Check if any output of the tracer is active.
+ *
+ * ~return: 1 if the events must be recorded, else 0.
+ */
+static int is_tracing()
+{
+    return tracer.enabled || tracer.marker_fd != NONE;
+}
+
+/*
+ * Write an event on the ftrace marker file. A failed write is ignored:
+ * the markers must never block or stop the tasks.
+ *
+ * name: name of the event.
+ * phase: phase of the event.
+ * arg: numeric argument of the event.
+ */
+static void write_marker(char *name, char phase, int arg)
+{
+    char    s[MARKER_LEN];
+    int     len;
+
+    len = snprintf(s, MARKER_LEN, "%c %s %i\n", phase, name, arg);
+    if (len > 0)
+    {
+        len = len < MARKER_LEN ? len : MARKER_LEN - 1;
+        if (write(tracer.marker_fd, s, len) < 0)
+        {
+            return;
+        }
+    }
+}
+
+/*
+ * Append an event to the buffer of the current thread and to the
+ * ftrace markers.
+ *
+ * slot: reference to the buffer.
+ * name: name of the event.
+ * phase: phase of the event.
+ * arg: numeric argument of the event.
+ */
+static void record(trace_slot_t *slot, char *name, char phase, int arg)
+{
+    trace_event_t   *e;
+
+    if (tracer.marker_fd != NONE)
+    {
+        write_marker(name, phase, arg);
+    }
+
+    if (!tracer.enabled)
+    {
+        return;
+    }
+
+    e = &(slot->events[slot->count % TRACE_EVENTS]);
+    e->ts = trace_time();
+    e->name = name;
+    e->phase = phase;
+    e->arg = arg;
+
+    /* Publish the event only after it was completely written. */
+    __atomic_store_n(&slot->count, slot->count + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Signal the start of the body of the current task and begin its
+ * first job.
+ */
+void trace_task_start(char *name)
+{
+    trace_slot_t    *slot;
+
+    if (is_tracing())
+    {
+        slot = current_slot();
+        slot->job = name;
+        strncpy(slot->name, name, TRACE_NAME_LEN - 1);
+        record(slot, name, 'B', 0);
+    }
+}
+
+/*
+ * Signal the end of the body of the current task.
+ */
+void trace_task_end()
+{
+    trace_slot_t    *slot;
+
+    if (is_tracing())
+    {
+        slot = current_slot();
+        if (slot->job != NULL)
+        {
+            record(slot, slot->job, 'E', 0);
+        }
+        slot->job = NULL;
+    }
+}
+
+/*
+ * Signal the end of the current job, before waiting for the period.
+ */
+void trace_job_end()
+{
+    trace_slot_t    *slot;
+
+    if (is_tracing())
+    {
+        slot = current_slot();
+        if (slot->job != NULL)
+        {
+            record(slot, slot->job, 'E', 0);
+        }
+    }
+}
+
+/*
+ * Signal the activation of a new job, after waiting for the period.
+ */
+void trace_job_start()
+{
+    trace_slot_t    *slot;
+
+    if (is_tracing())
+    {
+        slot = current_slot();
+        if (slot->job != NULL)
+        {
+            record(slot, slot->job, 'B', 0);
+        }
+    }
+}
+
+/*
+ * Begin a duration event in the current task.
+ */
+void trace_begin(char *name)
+{
+    if (is_tracing())
+    {
+        record(current_slot(), name, 'B', 0);
+    }
+}
+
+/*
+ * End a duration event in the current task.
+ */
+void trace_end(char *name)
+{
+    if (is_tracing())
+    {
+        record(current_slot(), name, 'E', 0);
+    }
+}
+
+/*
+ * Record an instant event in the current task.
+ */
+void trace_instant(char *name, int arg)
+{
+    if (is_tracing())
+    {
+        record(current_slot(), name, 'i', arg);
+    }
+}
+
+/*
+ * Record a deadline miss of the current task.
+ */
+void trace_deadline_miss()
+{
+    trace_slot_t    *slot;
+
+    if (is_tracing())
+    {
+        slot = current_slot();
+        record(slot, "deadline_miss", 'i', (int)(slot - tracer.slot));
+    }
+}
+
+/********************************************************************
+ * EXPORT
+********************************************************************/
+
+/*
+ * Write a single event in the trace-event format.
+ *
+ * out: trace file.
+ * e: reference to the event.
+ * tid: index of the buffer of the event.
+ * first: 1 if it is the first event in the file, else 0.
+ */
+static void write_event(FILE *out, trace_event_t *e, int tid, int first)
+{
+    fprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,"
+                 "\"pid\":1,\"tid\":%i",
+            first ? "" : ",", e->name, e->phase,
+            (unsigned long long)(e->ts / 1000),
+            (unsigned long long)(e->ts % 1000), tid);
+
+    if (e->phase == 'i')
+    {
+        fprintf(out, ",\"s\":\"t\",\"args\":{\"value\":%i}", e->arg);
+    }
+
+    fputs("}", out);
+}
+
+/*
+ * Write the name of a buffer as a metadata event.
+ *
+ * out: trace file.
+ * tid: index of the buffer.
+ * first: 1 if it is the first event in the file, else 0.
+ */
+static void write_thread_name(FILE *out, int tid, int first)
+{
+    fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                 "\"tid\":%i,\"args\":{\"name\":\"%s (task %i)\"}}",
+            first ? "" : ",", tid, tracer.slot[tid].name, tid);
+}
+
+/*
+ * Write the recorded events on the trace file.
+ */
+void flush_tracer()
+{
+    FILE            *out;
+    trace_slot_t    *slot;
+    uint64_t        count, i, dropped;
+    int             s, first;
+
+    if (!tracer.enabled)
+    {
+        return;
+    }
+
+    tracer.enabled = 0;     // Stop recording while writing.
+
+    out = fopen(tracer.path, "w");
+    if (out == NULL)
+    {
+        perror("TRACER: Unable to open the trace file");
+        return;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+    first = 1;
+    dropped = 0;
+
+    for (s = 0; s < TRACE_SLOTS; s++)
+    {
+        slot = &(tracer.slot[s]);
+        count = __atomic_load_n(&slot->count, __ATOMIC_ACQUIRE);
+        if (!count)
+        {
+            continue;
+        }
+
+        write_thread_name(out, s, first);
+        first = 0;
+
+        /* Only the last TRACE_EVENTS events are kept in the buffer. */
+        i = count > TRACE_EVENTS ? count - TRACE_EVENTS : 0;
+        dropped += i;
+        for (; i < count; i++)
+        {
+            write_event(out, &(slot->events[i % TRACE_EVENTS]), s, 0);
+        }
+    }
+
+    fputs("\n]}\n", out);
+    fclose(out);
+
+    fprintf(stderr, "TRACER: Trace written to %s (%llu events overwritten)\n",
+            tracer.path, (unsigned long long)dropped);
+}
@@ -0,0 +1,87 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the declarations of the task tracer and the
+ * function prototypes necessary to record timestamped events and
+ * export them in the Chrome trace-event format or as ftrace markers.
+ *
+********************************************************************/
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include "patriots.h"
+
+/********************************************************************
+ * TRACER PARAMETERS
+********************************************************************/
+
+// Number of events kept for each task (older events are overwritten).
+#define TRACE_EVENTS        16384
+// Maximum length of the name of a task in the trace.
+#define TRACE_NAME_LEN      32
+
+/*
+ * Initialize the tracer. Must be called by the main thread.
+ *
+ * path: file where the trace is written at exit, NULL to disable.
+ * markers: 1 to write the events on the ftrace trace_marker, else 0.
+ */
+void init_tracer(char *path, int markers);
+
+/*
+ * Signal the start of the body of the current task and begin its
+ * first job.
+ *
+ * name: name of the task class, used for the jobs in the trace.
+ */
+void trace_task_start(char *name);
+
+/*
+ * Signal the end of the body of the current task.
+ */
+void trace_task_end();
+
+/*
+ * Signal the end of the current job, before waiting for the period.
+ */
+void trace_job_end();
+
+/*
+ * Signal the activation of a new job, after waiting for the period.
+ */
+void trace_job_start();
+
+/*
+ * Begin a duration event in the current task.
+ *
+ * name: name of the event.
+ */
+void trace_begin(char *name);
+
+/*
+ * End a duration event in the current task.
+ *
+ * name: name of the event.
+ */
+void trace_end(char *name);
+
+/*
+ * Record an instant event in the current task.
+ *
+ * name: name of the event.
+ * arg: numeric argument attached to the event.
+ */
+void trace_instant(char *name, int arg);
+
+/*
+ * Record a deadline miss of the current task.
+ */
+void trace_deadline_miss();
+
+/*
+ * Write the recorded events on the trace file.
+ */
+void flush_tracer();
+
+#endif
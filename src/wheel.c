@@ -0,0 +1,313 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the timer wheels of the dispatcher tasks.
+ *
+ * Instead of a task (and a kernel timer) for every missile, the
+ * missiles are entries of the hierarchical timer wheels of
+ * WHEEL_DISPATCHERS periodic tasks. A dispatcher advances its wheel by
+ * one tick at every job and runs the entries expiring at that tick:
+ * - the first level has a slot for each of the next WHEEL_SLOTS
+ *   ticks, the next level a slot for each block of WHEEL_SLOTS ticks
+ *   of the previous one, cascaded down a level when its block starts;
+ * - the periods are rounded to the ticks and the first expiry of an
+ *   entry is aligned on its period, so the missiles with the same
+ *   period share the same wakeups (timer coalescing).
+ *
+ * An entry is run outside of the lock of its wheel, so a launcher can
+ * add a missile while the dispatcher runs the others.
+ *
+********************************************************************/
+
+#include "wheel.h"
+#include <string.h>
+#include <assert.h>
+#include <semaphore.h>
+#include "ptask.h"
+#include "gestor.h"
+#include "calib.h"
+
+// Entry of a wheel.
+typedef struct
+{
+    int         next;       // Next entry of the slot, NONE at the end.
+    long        expiry;     // Tick of the next run.
+    int         ticks;      // Period (ticks).
+    wheel_fn_t  fn;         // Function run at every period.
+    void        *arg;       // Argument of the function.
+}   wheel_entry_t;
+
+// Timer wheel of a dispatcher.
+typedef struct
+{
+    int     slot[WHEEL_LEVELS][WHEEL_SLOTS];    // First entry of the slots.
+    long    tick;                               // Current tick.
+    long    wakeups;                            // Ticks with entries run.
+    long    fired;                              // Entries run.
+    int     max_fired;                          // Most entries in a tick.
+    long    cascaded;                           // Entries moved a level down.
+    sem_t   mutex;                              // Mutex for the wheel.
+}   wheel_t;
+
+// Timer wheels of the dispatchers.
+typedef struct
+{
+    int             enabled;                    // Dispatchers flag.
+    wheel_t         wheel[WHEEL_DISPATCHERS];   // Wheels by dispatcher.
+    wheel_entry_t   entry[WHEEL_ENTRIES];       // Entries by identifier.
+}   wheels_t;
+
+static wheels_t     wheels;
+
+/*
+ * Initialize the timer wheels.
+ */
+void init_wheel(int enabled)
+{
+    wheel_t *w;
+    int     d, l, s;
+
+    memset(&wheels, 0, sizeof(wheels));
+    wheels.enabled = enabled;
+
+    for (d = 0; d < WHEEL_DISPATCHERS; d++)
+    {
+        w = &(wheels.wheel[d]);
+        for (l = 0; l < WHEEL_LEVELS; l++)
+        {
+            for (s = 0; s < WHEEL_SLOTS; s++)
+            {
+                w->slot[l][s] = NONE;
+            }
+        }
+
+        sem_init(&w->mutex, 0, 1);
+    }
+}
+
+/*
+ * Insert an entry in the slot of its expiry, on the lowest level that
+ * covers it. Called with the mutex of the wheel.
+ *
+ * w: reference to the wheel.
+ * id: identifier of the entry.
+ */
+static void insert_entry(wheel_t *w, int id)
+{
+    wheel_entry_t   *e;
+    long            delta, span, expiry;
+    int             l, s;
+
+    e = &(wheels.entry[id]);
+    expiry = e->expiry;
+    delta = expiry - w->tick;
+
+    span = 1;
+    for (l = 0; l < WHEEL_LEVELS - 1 && delta >= span * WHEEL_SLOTS; l++)
+    {
+        span *= WHEEL_SLOTS;
+    }
+
+    /* Beyond the last level: in its farthest slot, cascaded again. */
+    if (delta >= span * WHEEL_SLOTS)
+    {
+        expiry = w->tick + span * (WHEEL_SLOTS - 1);
+    }
+
+    s = (expiry / span) % WHEEL_SLOTS;
+    e->next = w->slot[l][s];
+    w->slot[l][s] = id;
+}
+
+/*
+ * Move the entries of the slots whose block starts at the current
+ * tick down to the lower levels. Called with the mutex of the wheel.
+ *
+ * w: reference to the wheel.
+ */
+static void cascade(wheel_t *w)
+{
+    long    span;
+    int     l, s, id, next;
+
+    span = 1;
+    for (l = 1; l < WHEEL_LEVELS; l++)
+    {
+        span *= WHEEL_SLOTS;
+        if (w->tick % span)
+        {
+            break;
+        }
+
+        s = (w->tick / span) % WHEEL_SLOTS;
+        id = w->slot[l][s];
+        w->slot[l][s] = NONE;
+
+        while (id != NONE)
+        {
+            next = wheels.entry[id].next;
+            insert_entry(w, id);
+            w->cascaded++;
+            id = next;
+        }
+    }
+}
+
+/*
+ * Advance a wheel by one tick and run the expired entries, inserting
+ * them again at their next period unless they are done.
+ *
+ * w: reference to the wheel.
+ */
+static void run_tick(wheel_t *w)
+{
+    wheel_entry_t   *e;
+    int             s, id, next, fired;
+
+    sem_wait(&w->mutex);
+
+    w->tick++;
+    cascade(w);
+
+    s = w->tick % WHEEL_SLOTS;
+    id = w->slot[0][s];
+    w->slot[0][s] = NONE;
+
+    sem_post(&w->mutex);
+
+    fired = 0;
+    while (id != NONE)
+    {
+        e = &(wheels.entry[id]);
+        next = e->next;
+
+        if (!e->fn(e->arg, e->ticks * WHEEL_TICK))
+        {
+            sem_wait(&w->mutex);
+            e->expiry += e->ticks;
+            insert_entry(w, id);
+            sem_post(&w->mutex);
+        }
+
+        fired++;
+        id = next;
+    }
+
+    w->wakeups += fired > 0;
+    w->fired += fired;
+    w->max_fired = fired > w->max_fired ? fired : w->max_fired;
+}
+
+/*
+ * Dispatcher task: runs the entries of its wheel at every tick.
+ */
+static ptask wheel_dispatcher()
+{
+    wheel_t *w;
+
+    w = ptask_get_argument();
+
+    task_start(WHEEL_TASK);
+
+    while (!end)
+    {
+        run_tick(w);
+
+        check_deadline("- Wheel dispatcher missed the deadline\n");
+
+        task_wait_for_period();
+    }
+
+    task_end();
+}
+
+/*
+ * Launch the dispatcher tasks.
+ */
+void launch_wheel_dispatchers()
+{
+    tpars   params;
+    int     d, task;
+
+    if (!wheels.enabled)
+    {
+        return;
+    }
+
+    for (d = 0; d < WHEEL_DISPATCHERS; d++)
+    {
+        ptask_param_init(params);
+        ptask_param_deadline(params, WHEEL_TICK, MILLI);
+        ptask_param_period(params, WHEEL_TICK, MILLI);
+        ptask_param_priority(params, class_priority(WHEEL_TASK));
+        ptask_param_activation(params, NOW);
+        ptask_param_argument(params, &(wheels.wheel[d]));
+
+        task = ptask_create_param(wheel_dispatcher, &params);
+
+        assert(task >= 0);
+    }
+
+    fprintf(stderr, "Created %i wheel dispatchers with tick: %i\n",
+            WHEEL_DISPATCHERS, WHEEL_TICK);
+}
+
+/*
+ * Add an entry to the wheel of a dispatcher.
+ */
+int wheel_add(int id, int period, wheel_fn_t fn, void *arg)
+{
+    wheel_entry_t   *e;
+    wheel_t         *w;
+
+    if (!wheels.enabled)
+    {
+        return -1;
+    }
+
+    assert(id >= 0 && id < WHEEL_ENTRIES);
+
+    w = &(wheels.wheel[id % WHEEL_DISPATCHERS]);
+    e = &(wheels.entry[id]);
+
+    e->ticks = (period + WHEEL_TICK - 1) / WHEEL_TICK;
+    e->fn = fn;
+    e->arg = arg;
+
+    sem_wait(&w->mutex);
+
+    /* Aligned on the period: the same periods share the wakeups. */
+    e->expiry = (w->tick / e->ticks + 1) * e->ticks;
+    insert_entry(w, id);
+
+    sem_post(&w->mutex);
+
+    return 0;
+}
+
+/*
+ * Print the wakeups and the entries run by every dispatcher.
+ */
+void print_wheel_report(FILE *out)
+{
+    wheel_t *w;
+    int     d;
+
+    if (!wheels.enabled)
+    {
+        return;
+    }
+
+    fprintf(out, "\n===== WHEELS =====\n");
+
+    for (d = 0; d < WHEEL_DISPATCHERS; d++)
+    {
+        w = &(wheels.wheel[d]);
+        fprintf(out, "dispatcher %i: ticks %li, wakeups with entries %li, "
+                     "entries run %li (%.1f per wakeup, max %i), "
+                     "cascaded %li\n",
+                d, w->tick, w->wakeups, w->fired,
+                w->wakeups ? (float)w->fired / w->wakeups : 0,
+                w->max_fired, w->cascaded);
+    }
+}
@@ -0,0 +1,82 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the parameters of the timer wheels and the
+ * function prototypes necessary to run the missiles inside a few
+ * dispatcher tasks.
+ *
+********************************************************************/
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stdio.h>
+
+#include "patriots.h"
+#include "launchers.h"
+
+/********************************************************************
+ * WHEEL PARAMETERS
+********************************************************************/
+
+// Period of the dispatcher tasks, a tick of their wheels (ms): the
+// greatest common divisor of the missile periods, so every missile
+// period is a whole number of ticks.
+#define WHEEL_TICK          5
+// Default priority of the dispatcher tasks, as the missile tasks.
+#define WHEEL_PRIO          ATK_MISSILE_PRIO
+// Number of dispatcher tasks, each with its own wheel.
+#define WHEEL_DISPATCHERS   2
+// Slots of every level of a wheel: the first level covers
+// WHEEL_SLOTS ticks, the second one WHEEL_SLOTS times as many.
+#define WHEEL_SLOTS         16
+// Levels of a wheel.
+#define WHEEL_LEVELS        2
+// Entries of the wheels: one for each missile, so they grow with N
+// (unlike the missile tasks, not limited by MAX_TASKS of the library).
+#define WHEEL_ENTRIES       (MISSILE_TYPES * N)
+
+/*
+ * Function run by a dispatcher at every period of an entry.
+ *
+ * arg: argument of the entry.
+ * period: period of the entry (ms).
+ * ~return: 1 to remove the entry, else 0.
+ */
+typedef int (*wheel_fn_t)(void *arg, int period);
+
+/*
+ * Initialize the timer wheels.
+ *
+ * enabled: 1 to run the missiles in the dispatcher tasks, else 0.
+ */
+void init_wheel(int enabled);
+
+/*
+ * Launch the dispatcher tasks. Nothing is done if not enabled.
+ */
+void launch_wheel_dispatchers();
+
+/*
+ * Add an entry to the wheel of a dispatcher, run from the next tick
+ * aligned on its period: the entries with the same period are fired
+ * by the same wakeup of the dispatcher.
+ *
+ * id: identifier of the entry, from 0 to WHEEL_ENTRIES - 1.
+ * period: period of the entry (ms), rounded up to the ticks.
+ * fn: function run at every period.
+ * arg: argument of the function.
+ * ~return: 0 on success, -1 if not enabled (the caller runs its own
+ * task).
+ */
+int wheel_add(int id, int period, wheel_fn_t fn, void *arg);
+
+/*
+ * Print the wakeups and the entries fired by every dispatcher, if
+ * enabled.
+ *
+ * out: stream where the report is written.
+ */
+void print_wheel_report(FILE *out);
+
+#endif
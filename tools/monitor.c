@@ -0,0 +1,233 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the reference monitor of the shared memory
+ * export of the system.
+ *
+ * The segment is mapped read-only: the monitor never writes in it
+ * and never synchronizes with the tasks. Every part of the segment
+ * is copied and the copy is retried if the sequence lock of the part
+ * shows that it was written in the meantime.
+ *
+ * Usage: monitor [-i ms] [-n count]
+ *   -i: interval between two prints (default MONITOR_INTERVAL ms).
+ *   -n: number of prints (default 0, until the system ends).
+ *
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "shmexport.h"
+
+// Default interval between two prints (ms).
+#define MONITOR_INTERVAL    500
+
+/********************************************************************
+ * SEQUENCE LOCK
+********************************************************************/
+
+/*
+ * Wait until a part protected by a sequence lock is not being written.
+ *
+ * seq: reference to the sequence of the part.
+ * ~return: sequence before the copy.
+ */
+static uint32_t seq_read_begin(uint32_t *seq)
+{
+    uint32_t    s;
+
+    while ((s = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1)
+    {
+        ;   // Writer inside: spin, the writes are short.
+    }
+
+    return s;
+}
+
+/*
+ * Check if a part protected by a sequence lock changed during the copy.
+ *
+ * seq: reference to the sequence of the part.
+ * start: sequence before the copy.
+ * ~return: 1 if the copy must be retried, else 0.
+ */
+static int seq_read_retry(uint32_t *seq, uint32_t start)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+/********************************************************************
+ * SEGMENT
+********************************************************************/
+
+/*
+ * Map the shared memory segment and check its layout.
+ *
+ * ~return: reference to the segment, NULL if not available.
+ */
+static shm_state_t *open_segment()
+{
+    shm_state_t *state;
+    int         fd;
+
+    fd = shm_open(SHM_NAME, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        perror("MONITOR: Unable to open the shared memory (run with -m)");
+        return NULL;
+    }
+
+    state = mmap(NULL, sizeof(shm_state_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (state == MAP_FAILED)
+    {
+        perror("MONITOR: Unable to map the shared memory");
+        return NULL;
+    }
+
+    if (memcmp(state->magic, SHM_MAGIC, sizeof(SHM_MAGIC)) != 0 ||
+        state->version != SHM_VERSION ||
+        state->size != sizeof(shm_state_t) ||
+        state->missiles != N || state->tasks != SHM_TASKS)
+    {
+        fprintf(stderr, "MONITOR: Incompatible shared memory layout\n");
+        return NULL;
+    }
+
+    return state;
+}
+
+/********************************************************************
+ * PRINT
+********************************************************************/
+
+/*
+ * Print a consistent copy of the world.
+ *
+ * state: reference to the segment.
+ */
+static void print_world(shm_state_t *state)
+{
+    shm_world_t w;
+    uint32_t    seq;
+    int         i;
+
+    do
+    {
+        seq = seq_read_begin(&state->seq);
+        memcpy(&w, &state->world, sizeof(w));
+    } while (seq_read_retry(&state->seq, seq));
+
+    printf("frame %llu, score: attacker %i, defender %i\n",
+           (unsigned long long)w.frame, w.atk_points, w.def_points);
+
+    for (i = 0; i < N; i++)
+    {
+        if (w.atk[i].active)
+        {
+            printf("    atk %i: (%3i, %3i) speed %6.2f angle %6.2f "
+                   "target %i\n", i, w.atk[i].x, w.atk[i].y,
+                   w.atk[i].speed, w.atk[i].angle, w.atk[i].target);
+        }
+    }
+
+    for (i = 0; i < N; i++)
+    {
+        if (w.def[i].active)
+        {
+            printf("    def %i: (%3i, %3i) speed %6.2f\n",
+                   i, w.def[i].x, w.def[i].y, w.def[i].speed);
+        }
+    }
+}
+
+/*
+ * Print a consistent copy of the statistics of the active tasks.
+ *
+ * state: reference to the segment.
+ */
+static void print_tasks(shm_state_t *state)
+{
+    shm_task_t  t;
+    uint32_t    seq;
+    int         i;
+
+    printf("    %-4s %-14s %10s %8s %12s %12s\n",
+           "task", "class", "jobs", "dmiss", "last (us)", "max (us)");
+
+    for (i = 0; i < SHM_TASKS; i++)
+    {
+        do
+        {
+            seq = seq_read_begin(&state->task[i].seq);
+            memcpy(&t, &state->task[i], sizeof(t));
+        } while (seq_read_retry(&state->task[i].seq, seq));
+
+        if (t.active)
+        {
+            printf("    %-4i %-14s %10llu %8llu %12.1f %12.1f\n",
+                   i, t.name, (unsigned long long)t.jobs,
+                   (unsigned long long)t.dmiss, t.last_ns / 1e3,
+                   t.max_ns / 1e3);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    shm_state_t     *state;
+    struct timespec interval;
+    int             c, ms, count, n;
+
+    ms = MONITOR_INTERVAL;
+    count = 0;
+
+    while ((c = getopt(argc, argv, "i:n:")) != -1)
+    {
+        switch (c)
+        {
+        case 'i':
+            ms = atoi(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-i ms] [-n count]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    state = open_segment();
+    if (state == NULL)
+    {
+        return 1;
+    }
+
+    interval.tv_sec = ms / 1000;
+    interval.tv_nsec = (ms % 1000) * 1000000L;
+
+    for (n = 0; count == 0 || n < count; n++)
+    {
+        print_world(state);
+        print_tasks(state);
+        fflush(stdout);
+
+        if (!__atomic_load_n(&state->running, __ATOMIC_ACQUIRE))
+        {
+            printf("system ended\n");
+            break;
+        }
+
+        nanosleep(&interval, NULL);
+    }
+
+    return 0;
+}
@@ -0,0 +1,468 @@
+/********************************************************************
+ * Lorenzo Bonicelli 2019
+ *
+ * This file contains the replay tool of the record files.
+ *
+ * The records are applied in order to the environment of the
+ * system, with the size of the recorded one, and every display frame
+ * (REC_TICK) is drawn with the same
+ * function of the display manager, at the original speed or at a
+ * different one. The environment module is included directly, like
+ * in the benchmarks, to use its internal (static) functions.
+ *
+ * With the analysis mode nothing is drawn: the records are scanned
+ * and a summary of the run is printed, so two recordings of the same
+ * scenario can be compared.
+ *
+ * Usage: replay [-a] [-x speed] file
+ *   -a: print the analysis of the run instead of drawing it.
+ *   -x: speed factor of the replay (default 1, 0 as fast as possible).
+ *
+********************************************************************/
+
+#include "gestor.c"
+#include "launchers.c"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "recorder.h"
+
+// Flag used to end all tasks loops (no task is spawned).
+int end;
+
+// Record file mapped in memory.
+typedef struct
+{
+    record_header_t *header;    // Header of the file.
+    record_t        *records;   // Records of the file.
+    uint64_t        count;      // Number of records.
+}   record_file_t;
+
+// Summary of a run.
+typedef struct
+{
+    uint64_t    types[REC_TYPES];                   // Records by type.
+    uint64_t    spawns[MISSILE_TYPES];              // Spawns by type.
+    uint64_t    deaths[MISSILE_TYPES];              // Deaths by type.
+    uint64_t    hits[DEF_MISSILE + 1];              // Collisions by cell.
+    uint64_t    misses[MAX_TASKS];                  // Deadline misses.
+    uint32_t    spawn_time[N];                      // Last attacker spawn.
+    uint64_t    assigns;                            // Assigned attackers.
+    double      assign_us, assign_max_us;           // Time to assignment.
+    uint32_t    last_tick, max_tick_us;             // Frame intervals.
+    int         atk_points, def_points;             // Final score.
+}   summary_t;
+
+/********************************************************************
+ * RECORD FILE
+********************************************************************/
+
+/*
+ * Map a record file in memory and check its header.
+ *
+ * path: path of the record file.
+ * file: reference to the mapped file.
+ * ~return: 1 if the file is valid, else 0.
+ */
+static int open_record_file(char *path, record_file_t *file)
+{
+    struct stat st;
+    void        *map;
+    uint64_t    size;
+    int         fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0 ||
+        st.st_size < sizeof(record_header_t))
+    {
+        fprintf(stderr, "REPLAY: Unable to open %s\n", path);
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("REPLAY: Unable to map the record file");
+        return 0;
+    }
+
+    file->header = map;
+    file->records = (record_t *)(file->header + 1);
+
+    if (memcmp(file->header->magic, RECORDER_MAGIC,
+               sizeof(RECORDER_MAGIC)) != 0 ||
+        file->header->version != RECORDER_VERSION ||
+        file->header->rec_size != sizeof(record_t) ||
+        file->header->missiles != N ||
+        !set_world_size(file->header->xwin, file->header->ywin, 0))
+    {
+        fprintf(stderr, "REPLAY: Incompatible record file %s\n", path);
+        return 0;
+    }
+
+    /* Without a count the run did not end: use the whole file. A count
+       beyond the file (truncated or corrupted) is limited to it. */
+    size = (st.st_size - sizeof(record_header_t)) / sizeof(record_t);
+    file->count = file->header->count;
+    if (!file->count)
+    {
+        file->count = size;
+    }
+    else if (file->count > size)
+    {
+        fprintf(stderr, "REPLAY: Truncated record file %s: %llu of %llu "
+                        "records\n", path, (unsigned long long)size,
+                (unsigned long long)file->count);
+        file->count = size;
+    }
+
+    return 1;
+}
+
+/*
+ * Check if a record is complete and refers to a valid missile.
+ *
+ * r: reference to the record.
+ * ~return: 1 if the record can be used, else 0.
+ */
+static int valid_record(record_t *r)
+{
+    return r->type != REC_NONE && r->type < REC_TYPES &&
+           r->kind < MISSILE_TYPES && r->index >= 0 && r->index < N;
+}
+
+/********************************************************************
+ * ANALYSIS
+********************************************************************/
+
+/*
+ * Add a record to the summary of the run.
+ *
+ * s: reference to the summary.
+ * r: reference to the record.
+ */
+static void analyze_record(summary_t *s, record_t *r)
+{
+    double  dt;
+
+    s->types[r->type]++;
+
+    switch (r->type)
+    {
+    case REC_TICK:
+        if (s->types[REC_TICK] > 1 && r->time - s->last_tick > s->max_tick_us)
+        {
+            s->max_tick_us = r->time - s->last_tick;
+        }
+        s->last_tick = r->time;
+        break;
+    case REC_SPAWN:
+        s->spawns[r->kind]++;
+        if (r->kind == ATTACKER)
+        {
+            s->spawn_time[r->index] = r->time;
+        }
+        break;
+    case REC_DEATH:
+        s->deaths[r->kind]++;
+        break;
+    case REC_ASSIGN:
+        dt = r->time - s->spawn_time[r->index];
+        s->assigns++;
+        s->assign_us += dt;
+        s->assign_max_us = dt > s->assign_max_us ? dt : s->assign_max_us;
+        break;
+    case REC_COLLISION:
+        if (r->value >= 0 && r->value <= DEF_MISSILE)
+        {
+            s->hits[r->value]++;
+        }
+        break;
+    case REC_SCORE:
+        s->atk_points = r->x;
+        s->def_points = r->y;
+        break;
+    case REC_DEADLINE_MISS:
+        if (r->value >= 0 && r->value < MAX_TASKS)
+        {
+            s->misses[r->value]++;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Print the summary of a run.
+ *
+ * file: reference to the record file.
+ */
+static void analyze(record_file_t *file)
+{
+    summary_t   s;
+    uint64_t    i, invalid;
+    uint32_t    duration;
+    int         t;
+
+    memset(&s, 0, sizeof(s));
+    invalid = 0;
+    duration = 0;
+
+    for (i = 0; i < file->count; i++)
+    {
+        if (!valid_record(&file->records[i]))
+        {
+            invalid++;
+            continue;
+        }
+        analyze_record(&s, &file->records[i]);
+        duration = file->records[i].time;
+    }
+
+    printf("records %llu (%llu invalid, %llu dropped), duration %.3f s\n",
+           (unsigned long long)file->count, (unsigned long long)invalid,
+           (unsigned long long)file->header->dropped, duration / 1e6);
+    printf("frames %llu, max frame interval %.3f ms (period %u ms)\n",
+           (unsigned long long)s.types[REC_TICK], s.max_tick_us / 1e3,
+           file->header->period);
+    printf("positions %llu\n", (unsigned long long)s.types[REC_POSITION]);
+    printf("attackers: %llu spawned, %llu removed\n",
+           (unsigned long long)s.spawns[ATTACKER],
+           (unsigned long long)s.deaths[ATTACKER]);
+    printf("defenders: %llu spawned, %llu removed\n",
+           (unsigned long long)s.spawns[DEFENDER],
+           (unsigned long long)s.deaths[DEFENDER]);
+    if (s.assigns)
+    {
+        printf("assignments %llu, time from spawn avg %.3f ms, max %.3f ms\n",
+               (unsigned long long)s.assigns,
+               s.assign_us / s.assigns / 1e3, s.assign_max_us / 1e3);
+    }
+    printf("collisions: %llu missile, %llu wall, %llu goal\n",
+           (unsigned long long)(s.hits[ATK_MISSILE] + s.hits[DEF_MISSILE]),
+           (unsigned long long)s.hits[WALL], (unsigned long long)s.hits[GOAL]);
+    printf("score: attacker %i, defender %i\n", s.atk_points, s.def_points);
+    printf("deadline misses %llu\n",
+           (unsigned long long)s.types[REC_DEADLINE_MISS]);
+    for (t = 0; t < MAX_TASKS; t++)
+    {
+        if (s.misses[t])
+        {
+            printf("    task %i: %llu\n", t, (unsigned long long)s.misses[t]);
+        }
+    }
+}
+
+/********************************************************************
+ * REPLAY
+********************************************************************/
+
+/*
+ * Get the cell of a missile in the environment.
+ * 
+ * type: type of the missile.
+ * index: index of the missile.
+ * ~return: cell of the missile, NONE if not in the environment.
+ */
+static pos_t get_missile_pos(missile_type_t type, int index)
+{
+    pos_t   pos;
+    int     slot;
+
+    slot = env.entity_slot[type][index];
+    if (slot == NONE)
+    {
+        pos.x = pos.y = NONE;
+    }
+    else
+    {
+        pos = env.entity[slot].pos;
+    }
+
+    return pos;
+}
+
+/*
+ * Remove a missile from the environment.
+ *
+ * kind: type of the missile.
+ * index: index of the missile.
+ */
+static void remove_missile(int kind, int index)
+{
+    pos_t   p;
+    cell_t  *cell;
+
+    p = get_missile_pos(kind, index);
+    if (p.x == NONE)
+    {
+        return;
+    }
+
+    /* The cell could already be taken by another missile. */
+    cell = &(CELL(p.x, p.y));
+    if (cell->type == missile_to_cell_type(kind) && cell->value == index)
+    {
+        init_cell_empty(cell);
+    }
+
+    set_missile_pos(kind, index, NONE, NONE);
+}
+
+/*
+ * Apply a record to the environment.
+ *
+ * r: reference to the record.
+ */
+static void apply_record(record_t *r)
+{
+    cell_t  *cell;
+
+    switch (r->type)
+    {
+    case REC_SPAWN:
+    case REC_POSITION:
+        if (check_borders(r->x, r->y))
+        {
+            remove_missile(r->kind, r->index);
+            cell = &(CELL(r->x, r->y));
+            cell->type = missile_to_cell_type(r->kind);
+            cell->value = r->index;
+            cell->target = r->type == REC_POSITION ? r->value : NONE;
+            set_missile_pos(r->kind, r->index, r->x, r->y);
+        }
+        break;
+    case REC_DEATH:
+        remove_missile(r->kind, r->index);
+        break;
+    case REC_ASSIGN:
+        if (check_borders(r->x, r->y))
+        {
+            CELL(r->x, r->y).target = r->value;
+        }
+        break;
+    case REC_SCORE:
+        env.atk_points = r->x;
+        env.def_points = r->y;
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Wait until the time of a record, scaled by the speed factor.
+ *
+ * start: time of the start of the replay.
+ * time: time of the record (us).
+ * speed: speed factor, 0 to never wait.
+ */
+static void wait_record_time(struct timespec *start, uint32_t time,
+                             float speed)
+{
+    struct timespec t;
+    uint64_t        ns;
+
+    if (speed <= 0)
+    {
+        return;
+    }
+
+    ns = (uint64_t)(time * 1000.0 / speed);
+    t.tv_sec = start->tv_sec + ns / 1000000000ULL;
+    t.tv_nsec = start->tv_nsec + ns % 1000000000ULL;
+    if (t.tv_nsec >= 1000000000L)
+    {
+        t.tv_sec++;
+        t.tv_nsec -= 1000000000L;
+    }
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+}
+
+/*
+ * Draw the run on screen, applying the records to the environment.
+ *
+ * file: reference to the record file.
+ * speed: speed factor, 0 to draw as fast as possible.
+ */
+static void replay(record_file_t *file, float speed)
+{
+    struct timespec start;
+    BITMAP          *buffer;
+    record_t        *r;
+    uint64_t        i;
+
+    init_gestor();
+    buffer = create_bitmap(xwin, ywin);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < file->count && !key[KEY_ESC]; i++)
+    {
+        r = &(file->records[i]);
+        if (r->type == REC_TICK)
+        {
+            wait_record_time(&start, r->time, speed);
+            draw_frame(buffer);
+        }
+        else if (valid_record(r))
+        {
+            apply_record(r);
+        }
+    }
+
+    allegro_exit();
+}
+
+int main(int argc, char **argv)
+{
+    record_file_t   file;
+    float           speed;
+    int             c, analysis;
+
+    analysis = 0;
+    speed = 1;
+
+    while ((c = getopt(argc, argv, "ax:")) != -1)
+    {
+        switch (c)
+        {
+        case 'a':
+            analysis = 1;
+            break;
+        case 'x':
+            speed = atof(optarg);
+            break;
+        default:
+            optind = argc + 1;  // Invalid option: print the usage.
+            break;
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "Usage: %s [-a] [-x speed] file\n", argv[0]);
+        return 1;
+    }
+
+    if (!open_record_file(argv[optind], &file))
+    {
+        return 1;
+    }
+
+    if (analysis)
+    {
+        analyze(&file);
+    }
+    else
+    {
+        replay(&file, speed);
+    }
+
+    return 0;
+}